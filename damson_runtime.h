@@ -48,6 +48,8 @@
 #define DAMSONRT_EV_START(n)   			(0x70000000 +((n-1)*DAMSONRT_EV_SIZE))	// starting address of ev for a core number 0<n<=16
 #define DAMSONRT_EV_SHARED_SIZE			(16*1024*1024) 			// size (bytes) of SDRAM shared space (16 Megabytes)
 #define DAMSONRT_EV_SHARED_START 		DAMSONRT_EV_START(17) 	// start address of SDRAM shared
+#define DAMSONRT_LOADER_RESERVED_SIZE	(5*1024*1024)			// bytes at the top of SDRAM shared kept by the loader (staging, prototypes and load epoch), not used by the runtime
+#define DAMSONRT_LOADER_RESERVED_START	(DAMSONRT_EV_SHARED_START+DAMSONRT_EV_SHARED_SIZE-DAMSONRT_LOADER_RESERVED_SIZE)	// end of the SDRAM shared space the runtime may use
 
 /* clock rate*/
 #define DAMSONRT_TICKRATE_MICROS		1000000		//1 second tick
@@ -68,7 +70,15 @@
 #define API_PRINT_DLY 				200		//usec delay to ensure io has completed
 
 
+/* routing table, written to shared SDRAM after the core map (one word per chip). The loader writes exact tables unless it is
+ * built with LOADER_MASKED_ROUTES:
+ *   exact:  count, then count entries of 2 words {key, route}, a packet matches an entry if (packet key & ~DAMSON_PORT_MASK) == key
+ *   masked: DAMSONRT_ROUTING_TABLE_FORMAT, count, then count entries of 3 words {key, mask, route}, a packet matches an
+ *           entry if (packet key & mask) == key (a runtime which reads masked tables must reject a table which does not
+ *           start with the format word)
+ * route bits [0-5] are links and [6-23] are cores */
 #define MAX_ROUTING_TABLE_ENTRIES		999
+#define DAMSONRT_ROUTING_TABLE_FORMAT	0x52544d32	// first word of a table of masked entries ("RTM2")
 
 
 
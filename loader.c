@@ -3,6 +3,9 @@
 #include <stdarg.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
 
 #include "loader.h"
 #include "spiNN_runtime.h"
@@ -17,23 +20,123 @@
 #define LINK_SOUTH			1<<5
 #define NUM_LINKS			6
 
+#define MAX_NODE_TRANSFERS	32		//maximum transfers of a node in flight at once
+#define LOAD_QUEUE_SIZE		16		//maximum nodes waiting for a load worker (each holds copies of its vectors)
+#define MAX_BOARDS			64		//maximum boards in the machine description
+#define MAX_CHIP_PROTOTYPES	16		//maximum prototypes held in shared SDRAM by a chip
+#define ROUTE_BATCH			256		//interrupts taken by a route thread at a time
+#define CHIP_NODE_CORES		16		//cores of a chip which run nodes (1-16)
+#define ANNEAL_COOLING		0.9		//temperature ratio between annealing steps
+#define ANNEAL_MOVES_PER_NODE	300		//moves tried for each node over the whole anneal (shared out over the temperature steps)
+#define ANNEAL_MAX_MOVES	3000000	//moves tried over the whole anneal (bounds the time taken by large graphs)
+#define ANNEAL_MAX_STEPS	60		//temperature steps before annealing stops
+#define ANNEAL_TABLE_BUDGET	(MAX_ROUTING_TABLE_ENTRIES/2)	//edges leaving a chip before the anneal penalises it (the rest of the table is left for routes passing through)
+#define ANNEAL_TABLE_PENALTY	8		//weighted hops added for each edge leaving a chip over its budget
+#define ANNEAL_MIN_BUDGET	(MAX_ROUTING_TABLE_ENTRIES/16)	//smallest budget tried before nodes are placed in list order
+#define SHADOW_MAGIC		0x444c5331	//identifies a shadow file ("DLS1")
+
+/* States of a prototype in the shared SDRAM of a chip */
+#define PROTOTYPE_UNWRITTEN	0
+#define PROTOTYPE_WRITING	1
+#define PROTOTYPE_WRITTEN	2		//cores copy it from then on
+
 
 /*
  * Structure to hold a a single routing table entry
  */
 typedef struct {
-	unsigned int key; 	//damson source node id
+	unsigned int key; 	//damson source node id (shifted by DAMSONRT_PORT_BITS)
+	unsigned int mask;	//bits of a packet key compared with the key
 	unsigned int route; //the route bits, [0-5]=links, [6-23]=cores
 }RoutingEntry;
 
+/*
+ * Routing table entry as written to an exact table (LOADER_MASKED_ROUTES == 0)
+ */
+typedef struct {
+	unsigned int key;
+	unsigned int route;
+}ExactRoutingEntry;
+
+/*
+ * A prototype held in the shared SDRAM of a chip
+ */
+typedef struct {
+	char name[MAX_STRING_SIZE];
+	unsigned int content_hash;
+	unsigned int address;	//shared SDRAM address of the program
+	unsigned int size;		//bytes (whole words)
+	int state;
+} ChipPrototype;
+
+/*
+ * Shared SDRAM of a chip as written by the previous load (read from the shadow file)
+ */
+typedef struct {
+	unsigned int epoch;						//token written to the chip once the load completed (0 if none)
+	unsigned int prototype_count;
+	ChipPrototype prototypes[MAX_CHIP_PROTOTYPES];	//names are not kept
+	unsigned int table_blocks;
+	unsigned int *table_hashes;				//hashes of the core map and routing table (LOADER_SHADOW_BLOCK bytes each)
+} ChipShadow;
+
 /*
  * Holds the routing table entries for a single chip
  */
 typedef struct {
 	uint rt_count;
-	RoutingEntry rt[MAX_ROUTING_TABLE_ENTRIES];
+	unsigned int rt_size;				//entries allocated (exceeds MAX_ROUTING_TABLE_ENTRIES until minimised)
+	RoutingEntry *rt;
+	unsigned int *rt_index;				//entry of each key while the table is built (entry+1 by key hash, 0 if free)
+	unsigned int rt_index_size;			//power of 2
+	pthread_mutex_t rt_lock;			//routes are added by several threads
+	ChipPrototype prototypes[MAX_CHIP_PROTOTYPES];
+	unsigned int prototype_count;
+	unsigned int prototype_area_used;	//bytes of the prototype area allocated
+	char *tables;						//core map and routing table as written to shared SDRAM
+	unsigned int table_size;
+	unsigned int table_blocks;
+	unsigned int *table_hashes;
+	ChipShadow shadow;
+	int shadow_valid;					//set if the shared SDRAM still holds what the shadow describes
 } ChipConfig;
 
+/*
+ * A board of the machine (connected through the Ethernet chip at its chip offset)
+ */
+typedef struct {
+	char ip[128];				//ip address of the board Ethernet chip
+	unsigned int x;				//chip x of the board Ethernet chip
+	unsigned int y;				//chip y of the board Ethernet chip
+	spiNN_context *context;		//connection to the board
+	pthread_t thread;			//boot thread
+	int booted;
+} Board;
+
+/*
+ * Transfers of a node which have been submitted but not yet checked
+ */
+typedef struct {
+	spiNN_context *contexts[MAX_NODE_TRANSFERS];
+	spiNN_request requests[MAX_NODE_TRANSFERS];
+	char *descriptions[MAX_NODE_TRANSFERS];
+	unsigned int count;
+} NodeTransfers;
+
+/*
+ * A node waiting for a load worker (vectors are copies as main reuses its buffers for the next node)
+ */
+typedef struct {
+	unsigned int    node;
+	char            prototype_object_name[MAX_STRING_SIZE];
+	int             *gv;       unsigned int gvusersize;
+	int             *ev;       unsigned int evsize;
+	InterruptVector *intv;     unsigned int intvsize;
+	RuntimeLogItem  *logs;     unsigned int num_logs;
+	RuntimeLogItem  *snapshots;unsigned int num_snapshots;
+	int             debug_mode;
+} LoadJob;
+
 /*
  * Structure to hold a linked list of node mappings
  */
@@ -44,6 +147,47 @@ struct NodeMapItemList
 	NodeMapItemList* next;
 };
 
+/*
+ * Interrupts shared out to the route threads (sorted by source, each thread takes the next sources and then the next chips)
+ */
+typedef struct {
+	unsigned long long *pairs;		//source << 32 | destination
+	unsigned int pair_count;
+	unsigned int next_pair;			//first interrupt of the next source to route
+	unsigned int next_chip;			//next chip to minimise
+	pthread_mutex_t lock;
+} RouteWork;
+
+/*
+ * Interrupt graph of the nodes being placed (vertices are nodes in list order and every edge is held by both of its vertices)
+ */
+typedef struct {
+	unsigned int vertices;
+	unsigned int *ids;				//damson node id of each vertex
+	unsigned int *edge_start;		//first edge of each vertex (vertices+1 entries)
+	unsigned int *edge_target;
+	unsigned int *edge_weight;		//interrupts between the two nodes (both directions)
+	unsigned int *chip;				//chip of each vertex (y + x*width)
+	int *gain;						//scratch
+	char *side;						//scratch
+	unsigned int *mark;				//scratch
+	unsigned int stamp;
+	unsigned int table_budget;		//edges leaving a chip before the annealing cost penalises its routing table
+	unsigned int *chip_edges;		//edges leaving each chip (an upper bound of the table entries of the nodes on it)
+	int *chip_change;				//change in the edges leaving each chip of the move being tried (scratch)
+	unsigned int *touched;			//chips with a change (scratch)
+	char *listed;					//chip is in touched (scratch)
+	unsigned int touched_count;
+} PlacementGraph;
+
+/*
+ * Vertex and key used to sort vertices
+ */
+typedef struct {
+	int key;
+	unsigned int vertex;
+} PlacementKey;
+
 /*
  * Structure to hold node mappings from the mapping file
  */
@@ -70,19 +214,72 @@ HardwareMapping 	GetReverseMapping(unsigned int spinnaker_id);
 unsigned int		NextPower2(unsigned int hash_list_size);		//must be a power of 2
 
 SpiNN_address 		GetSpiNNAddress(unsigned int spinnaker_id);
+spiNN_context*		GetContext(SpiNN_address address);
+unsigned int		ChipDistance(unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1);
+void				ChipOffset(unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, int *dx, int *dy);
+unsigned int		HexHops(int dx, int dy);
+void*				BootBoard(void *board);
 void 				BuildDeviceIntVector(InterruptVector *int_hash, InterruptVector *intv, unsigned int intvsize);
 
 void 				HandleDebugMessage(SpiNN_address address, char* message);
 
-void 				Route(unsigned int src_id, unsigned int dst_id);
-void 				createRoutingEntry(unsigned int chip_index, unsigned int src_id, unsigned int route);
+void 				RouteTree(unsigned int src_id, unsigned int *dst_ids, unsigned int count);
+void 				createRoutingEntry(unsigned int chip_index, unsigned int key, unsigned int route);
+int 				BuildRoutingTables();
+void*				RouteWorker(void *arg);
+void*				MinimiseWorker(void *arg);
+void 				GrowRoutingIndex(ChipConfig *c);
+void 				ClearMapping();
+void 				AssignCores(unsigned int *chip_of);
+void 				MinimiseRoutingTable(ChipConfig *c);
+void 				ExactRoutingTable(ChipConfig *c);
+int 				RouteCollides(RoutingEntry *keys, unsigned int count, unsigned int key, unsigned int mask, unsigned int route);
+unsigned int		FindRoutingKey(RoutingEntry *keys, unsigned int low, unsigned int count, unsigned int key);
+int 				CompareRoutingKeys(const void *a, const void *b);
+int 				CompareRoutingRoutes(const void *a, const void *b);
+unsigned int		RouteStep(SpiNN_address *tmp_adr, SpiNN_address dst_adr);
+int 				PlaceNodes(unsigned int *chip_of, unsigned int table_budget);
+void 				PlaceNodesLinear(unsigned int *chip_of);
+void 				BuildPlacementGraph(PlacementGraph *g);
+void 				FreePlacementGraph(PlacementGraph *g);
+void 				BisectPlacement(PlacementGraph *g, unsigned int *vertices, unsigned int count, unsigned int x0, unsigned int y0, unsigned int width, unsigned int height);
+void 				GrowBisection(PlacementGraph *g, unsigned int *vertices, unsigned int count, unsigned int size0);
+void 				RefineBisection(PlacementGraph *g, unsigned int *vertices, unsigned int count);
+void 				AnnealPlacement(PlacementGraph *g);
+int 				PlacementDelta(PlacementGraph *g, unsigned int v, unsigned int chip, unsigned int other);
+int 				TableDelta(PlacementGraph *g, unsigned int v, unsigned int chip, unsigned int other);
+void 				MoveTableEdges(PlacementGraph *g, unsigned int v, unsigned int from, unsigned int to, unsigned int other);
+void 				ChangeTableEdges(PlacementGraph *g, unsigned int chip, int change);
+void 				EndTableDelta(PlacementGraph *g, int apply);
+unsigned int		PlacementCost(PlacementGraph *g);
+unsigned int		PlacementDistance(unsigned int chip0, unsigned int chip1);
+unsigned int		PlacementRandom(unsigned int n);
+int 				ComparePlacementKeys(const void *a, const void *b);
+int 				CompareNodeIds(const void *a, const void *b);
+int 				CompareEdgePairs(const void *a, const void *b);
+
+void 				CheckTransfer(int result, unsigned int node, char* description);
+void 				QueueTransfer(NodeTransfers *transfers, spiNN_context *context, spiNN_request request, unsigned int node, char* description);
+void 				WaitTransfers(NodeTransfers *transfers, unsigned int node);
+void*				LoadWorker(void *arg);
+void 				LoadQueuedNode(LoadJob *job, NodeTransfers *transfers);
+void*				CopyVector(void *vector, unsigned int size);
+void 				AllocatePrototype(unsigned int node, char *prototype_object_name);
+unsigned int		SharePrototype(spiNN_context *context, SpiNN_address node_address, unsigned int chip, char *prototype_object_name, unsigned int node, unsigned int *size);
+void 				WriteChipTables(NodeTransfers *transfers, spiNN_context *context, SpiNN_address node_address, unsigned int chip, unsigned int node);
+unsigned int		HashBlock(char *data, unsigned int size);
+void 				ReadShadow();
+void 				WriteShadow();
 
 void 				Damson_fprintf(FILE *stream, char *fmt, ...);
 
 
-char 					spinnaker_ip[128];
+Board					boards[MAX_BOARDS];
+unsigned int			num_boards = 0;
+unsigned int			*chip_board = NULL;		//board which carries the traffic of each chip
 unsigned int			spinnaker_layout_width = 0;
 unsigned int			spinnaker_layout_height = 0;
+int						spinnaker_wrap = 0;		//machine edges are joined by wrap around links (torus)
 unsigned int			spinnaker_chips = 0;
 unsigned int			MappingHashSize = 0;
 HardwareMapping*		MappingHash = NULL;
@@ -94,10 +291,33 @@ unsigned int 			*core_map;
 int						spinnaker_running = 0;
 NodeMapItemList			*node_map_start = NULL;
 unsigned int			node_count = 0;
+unsigned int			placement_seed = 0x2545f491;	//fixed so that a model is always placed the same way
 FILE 					*spinnaker_config_file = NULL;
+LoadJob					load_queue[LOAD_QUEUE_SIZE];		//nodes waiting for a load worker (circular)
+unsigned int			load_queue_head = 0;
+unsigned int			load_queue_count = 0;
+pthread_mutex_t			load_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t			load_queue_not_empty = PTHREAD_COND_INITIALIZER;
+pthread_cond_t			load_queue_not_full = PTHREAD_COND_INITIALIZER;
+pthread_t				load_workers[LOADER_WORKERS];
+int						load_workers_started = 0;
+int						loading_finished = 0;
+pthread_mutex_t			prototype_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t			prototype_written = PTHREAD_COND_INITIALIZER;
+unsigned int			load_epoch = 0;						//token written to every chip once the load is complete
+unsigned int			no_epoch = 0;
+unsigned int			verify_failures = 0;				//nodes which failed verification (guarded by load_queue_lock)
 
 
 void InitLoader(){
+	Board *b;
+	SpiNN_chip_address chip_address;
+	unsigned int chip;
+	unsigned int x;
+	unsigned int y;
+	unsigned int i;
+	char line[256];
+	char option[16];
 
 	spinnaker_config_file = fopen ("spinnaker.ini","r");
 
@@ -107,41 +327,124 @@ void InitLoader(){
 		exit(0);
 	}
 
-	//get the spinnaker configuration
-    if (fscanf(spinnaker_config_file, "%s %u %u\n", spinnaker_ip, &spinnaker_layout_width, &spinnaker_layout_height) != 3) {
+	//get the spinnaker configuration (first board is the machine origin, optionally followed by 'wrap' for a torus)
+    option[0] = 0;
+    if ((!fgets(line, sizeof(line), spinnaker_config_file)) || (sscanf(line, "%127s %u %u %15s", boards[0].ip, &spinnaker_layout_width, &spinnaker_layout_height, option) < 3)) {
 		//error (to be replaced with damson error function for safe shutdown)
-		printf("Error: SpiNNaker config file does not contain a SpiNNaker Configuration in the format 'ip_address layout_width layout_height'\n");
+		printf("Error: SpiNNaker config file does not contain a SpiNNaker Configuration in the format 'ip_address layout_width layout_height [wrap]'\n");
 		exit(0);
     }
+    if (option[0]){
+    	if (strcmp(option, "wrap") != 0){
+    		printf("Error: Unknown SpiNNaker configuration option '%s' (expected 'wrap')\n", option);
+    		exit(0);
+    	}
+    	spinnaker_wrap = 1;
+    }
+    num_boards = 1;
+
+    //any further boards are listed with the chip offset of their Ethernet chip
+    while (fgets(line, sizeof(line), spinnaker_config_file)){
+    	if (sscanf(line, "%15s", option) < 1)
+    		continue;
+    	if (num_boards == MAX_BOARDS){
+    		printf("Error: SpiNNaker config file lists more than %d boards\n", MAX_BOARDS);
+    		exit(0);
+    	}
+    	if (sscanf(line, "%127s %u %u", boards[num_boards].ip, &boards[num_boards].x, &boards[num_boards].y) != 3)
+    		break;
+    	if ((boards[num_boards].x >= spinnaker_layout_width)||(boards[num_boards].y >= spinnaker_layout_height)){
+    		printf("Error: SpiNNaker board '%s' chip offset (%u,%u) is outside of the machine layout\n", boards[num_boards].ip, boards[num_boards].x, boards[num_boards].y);
+    		exit(0);
+    	}
+    	num_boards++;
+    }
+
     spinnaker_chips = spinnaker_layout_width*spinnaker_layout_height;
+
+    //the core map and the largest routing table must end below the shared SDRAM reserved for the loader
+    if (DAMSONRT_EV_SHARED_START + spinnaker_chips*sizeof(unsigned int) + 2*sizeof(unsigned int) + MAX_ROUTING_TABLE_ENTRIES*sizeof(RoutingEntry) > DAMSONRT_LOADER_RESERVED_START){
+    	printf("Error: SpiNNaker layout of %u chips is too large for the core map and routing tables in shared SDRAM\n", spinnaker_chips);
+    	exit(0);
+    }
     chips = (ChipConfig*)malloc(spinnaker_chips*sizeof(ChipConfig));
     core_map = (unsigned int*)malloc(spinnaker_chips*sizeof(unsigned int));
+    chip_board = (unsigned int*)malloc(spinnaker_chips*sizeof(unsigned int));
 
     memset(chips, 0, spinnaker_chips*sizeof(ChipConfig));
     memset(core_map, 0, spinnaker_chips*sizeof(unsigned int));
+    for (i=0; i<spinnaker_chips; i++)
+    	pthread_mutex_init(&chips[i].rt_lock, NULL);
 
     fclose(spinnaker_config_file);
 
-    //init the spinnaker board
-    if (spiNN_init(spinnaker_ip, spinnaker_layout_width, spinnaker_layout_height) == SPINN_FAILURE){
-		printf("Error: Failed to Initialise SpiNNaker hardware\n");
-		exit(0);
-	}
+    //traffic for each chip goes through the nearest Ethernet chip
+    for (x=0; x<spinnaker_layout_width; x++){
+    	for (y=0; y<spinnaker_layout_height; y++){
+    		chip = y + (x*spinnaker_layout_width);
+    		chip_board[chip] = 0;
+    		for (i=1; i<num_boards; i++){
+    			if (ChipDistance(x, y, boards[i].x, boards[i].y) < ChipDistance(x, y, boards[chip_board[chip]].x, boards[chip_board[chip]].y))
+    				chip_board[chip] = i;
+    		}
+    	}
+    }
 
-    sleep(1); //WTF??
+    //init the spinnaker boards (booted concurrently)
+    for (i=0; i<num_boards; i++){
+    	b = &boards[i];
+    	b->context = spiNN_create_context();
+    	if (b->context == NULL){
+    		printf("Error: Failed to Initialise SpiNNaker hardware\n");
+    		exit(0);
+    	}
+    	spiNN_set_debug_listener(b->context, (i == 0));	//debug output of every board is sent to the listener of the first
+	#if LOADER_WARM_ATTACH == 1
+    	spiNN_set_boot_mode(b->context, SPINN_BOOT_ATTACH);
+	#endif
+    	pthread_create(&b->thread, NULL, BootBoard, b);
+    }
+    for (i=0; i<num_boards; i++){
+    	pthread_join(boards[i].thread, NULL);
+    	if (!boards[i].booted){
+    		printf("Error: Failed to Initialise SpiNNaker hardware (board %s)\n", boards[i].ip);
+    		exit(0);
+    	}
+    }
+
+    //wait until point to point routes to every chip are up (rather than sleeping)
+    for (x=0; x<spinnaker_layout_width; x++){
+    	for (y=0; y<spinnaker_layout_height; y++){
+    		chip_address.x = x;
+    		chip_address.y = y;
+    		if (spiNN_wait_for_chip(boards[chip_board[y + (x*spinnaker_layout_width)]].context, chip_address, LOADER_READY_TIMEOUT) == SPINN_FAILURE){
+    			printf("Error: SpiNNaker chip (%u,%u) is not responding\n", x, y);
+    			exit(0);
+    		}
+    	}
+    }
 
     //init debug output
     spinnaker_running = 1;
-    spiNN_debug_message_callback(&HandleDebugMessage);
+    spiNN_debug_message_callback(boards[0].context, &HandleDebugMessage);
 }
 
 void ExitLoader()
 {
+	unsigned int i;
+
 	free(MappingHash);
 	free(ReverseMappingHash);
+	for (i=0; i<spinnaker_chips; i++){
+		free(chips[i].rt);
+		free(chips[i].rt_index);
+		pthread_mutex_destroy(&chips[i].rt_lock);
+	}
 	free(chips);
 	free(core_map);
-	spiNN_exit();
+	free(chip_board);
+	for (i=0; i<num_boards; i++)
+		spiNN_exit(boards[i].context);
 }
 
 /**
@@ -174,12 +477,12 @@ void AddNodeMapItem(NodeMapItem *map)
  **/
 void MapNodes()
 {
-	unsigned int i;
 	NodeMapItemList *n;
 	NodeMapItemList *temp;
-	unsigned int next_core;
-	unsigned int next_chip_x;
-	unsigned int next_chip_y;
+	unsigned int *chip_of;
+	unsigned int budget;
+	int placed;
+	int overflow;
 
 	//init hardware mapping hash
 	MappingHashSize = (node_count)*2;
@@ -188,30 +491,83 @@ void MapNodes()
 	memset(MappingHash, 0 , sizeof(HardwareMapping)*MappingHashSize);
 	memset(ReverseMappingHash, 0 , sizeof(HardwareMapping)*MappingHashSize);
 
-    //init hardware mappings
-    next_core = 0;
-    next_chip_x = 0;
-    next_chip_y = 0;
+	if (node_count > spinnaker_layout_width*spinnaker_layout_height*CHIP_NODE_CORES){
+		printf("Error: Mapper has run out of available SpiNNaker cores\n");
+		exit(0);
+	}
+
+	//place nodes on chips (nodes are in list order)
+	chip_of = (unsigned int*)malloc((node_count ? node_count : 1)*sizeof(unsigned int));
+	placed = 0;
+	budget = ANNEAL_TABLE_BUDGET;
+	#if LOADER_PLACEMENT == 1
+		placed = PlaceNodes(chip_of, budget);
+	#endif
+	if (!placed)
+		PlaceNodesLinear(chip_of);
+	AssignCores(chip_of);
+
+	//route every interrupt (placed again with a smaller table budget if a routing table overflows, in list order once the
+	//budget is exhausted)
+	overflow = BuildRoutingTables();
+	while ((overflow >= 0) && placed){
+		ClearMapping();
+		budget /= 2;
+		if (budget < ANNEAL_MIN_BUDGET){
+			printf("Warning: placement overflows the routing table of chip %d (nodes are placed in order)\n", overflow);
+			placed = 0;
+			PlaceNodesLinear(chip_of);
+		}else{
+			printf("Warning: placement overflows the routing table of chip %d (placing again with a budget of %u edges a chip)\n", overflow, budget);
+			PlaceNodes(chip_of, budget);
+		}
+		AssignCores(chip_of);
+		overflow = BuildRoutingTables();
+	}
+	if (overflow >= 0){
+		printf("Error: Chip %d routing table overflow (%d entries)\n", overflow, chips[overflow].rt_count);
+		exit(0);
+	}
+	free(chip_of);
 
-    //iterate node map list to create mappings
+	//cleanup link list
 	n = node_map_start;
+	while (n != NULL){
+		//iterate and remove mapping
+		temp = n->next;
+		free(n->node_map_item.interrupts);
+		free(n);
+		n = temp;
+	}
+}
+
+
+/**
+ * Creates the hardware mapping of every node from its chip (y + x*width), the cores of a chip are used from core 1 in list order
+ */
+void AssignCores(unsigned int *chip_of)
+{
+	unsigned int i;
+	NodeMapItemList *n;
+	unsigned int *chip_cores;
+	unsigned int core;
+	unsigned int chip_x;
+	unsigned int chip_y;
+
+	chip_cores = (unsigned int*)calloc((spinnaker_layout_width-1)*spinnaker_layout_width + spinnaker_layout_height, sizeof(unsigned int));
+
+	//iterate node map list to create mappings
+	n = node_map_start;
+	i = 0;
 	while (n != NULL){
 		HardwareMapping hardware_mapping;
 		hardware_mapping.damson_node_id = n->node_map_item.damson_node_id;
 
-		//linear mapping: get next available core
-		next_core++;
-		if (next_core > 16){
-			next_chip_x++;
-			next_core = 1;
-		}if (next_chip_x > (spinnaker_layout_width-1)){
-			next_chip_y++;
-			next_chip_x = 0;
-		}if(next_chip_y > (spinnaker_layout_height-1)){
-			printf("Error: Mapper has run out of available SpiNNaker cores\n");
-			exit(0);
-		}
-		hardware_mapping.spinnaker_id = (next_chip_x << 16) + (next_chip_y << 8) + next_core;
+		chip_x = chip_of[i] / spinnaker_layout_width;
+		chip_y = chip_of[i] % spinnaker_layout_width;
+		core = ++chip_cores[chip_of[i]];
+		i++;
+		hardware_mapping.spinnaker_id = (chip_x << 16) + (chip_y << 8) + core;
 		//copy node map info (prototype name??)
 		hardware_mapping.num_logs = n->node_map_item.num_logs;
 		hardware_mapping.logs = n->node_map_item.logs;
@@ -219,35 +575,835 @@ void MapNodes()
 		hardware_mapping.snapshots = n->node_map_item.snapshots;
 
 		//set core map
-		core_map[next_chip_y + (next_chip_x*spinnaker_layout_width)] |= 1<<next_core;
+		core_map[chip_y + (chip_x*spinnaker_layout_width)] |= 1<<core;
 
 		AddMapping(hardware_mapping);
 		AddReverseMapping(hardware_mapping);
 
 		n = n->next;
 	}
+	free(chip_cores);
+}
+
+/**
+ * Removes the hardware mapping, core map and routing tables of a placement
+ */
+void ClearMapping()
+{
+	unsigned int i;
+
+	memset(MappingHash, 0 , sizeof(HardwareMapping)*MappingHashSize);
+	memset(ReverseMappingHash, 0 , sizeof(HardwareMapping)*MappingHashSize);
+	memset(core_map, 0, spinnaker_chips*sizeof(unsigned int));
+	for (i=0; i<spinnaker_chips; i++)
+		chips[i].rt_count = 0;
+}
+
+/**
+ * Creates the routing table of every chip from the interrupts of the node map list and minimises them (if
+ * LOADER_MASKED_ROUTES is set, otherwise the exact entries are kept). Sources are routed and chips are minimised by
+ * LOADER_ROUTE_THREADS threads (tables are sorted so do not depend on the order the routes were added in). Returns the
+ * first chip whose table holds more than MAX_ROUTING_TABLE_ENTRIES (-1 if every table fits).
+ */
+int BuildRoutingTables()
+{
+	unsigned int i;
+	NodeMapItemList *n;
+	SpiNN_address adr;
+	RouteWork work;
+	pthread_t threads[LOADER_ROUTE_THREADS];
+	int overflow;
+	#if LOADER_DEBUG == 1
+		struct timespec t1, t2;
+
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+	#endif
 
-	//iterate node map list to create routing tables
+	//every node has an entry on its own chip (an empty route until it is routed) so that merged entries never match its packets
 	n = node_map_start;
 	while (n != NULL){
+		adr = GetSpiNNAddress(GetMapping(n->node_map_item.damson_node_id).spinnaker_id);
+		createRoutingEntry(adr.y + (adr.x * spinnaker_layout_width), n->node_map_item.damson_node_id << DAMSONRT_PORT_BITS, 0);
+		n = n->next;
+	}
+
+	//interrupts of the node map list grouped by source (packed as source << 32 | destination)
+	memset(&work, 0, sizeof(RouteWork));
+	for (n = node_map_start; n != NULL; n = n->next)
+		work.pair_count += n->node_map_item.num_interrupts;
+	work.pairs = (unsigned long long*)malloc((work.pair_count+1)*sizeof(unsigned long long));
+	work.pair_count = 0;
+	for (n = node_map_start; n != NULL; n = n->next){
 		for (i=0; i< n->node_map_item.num_interrupts; i++){
 			if (n->node_map_item.interrupts[i] != 0)	//dont map timer interrupt
-				Route(n->node_map_item.interrupts[i], n->node_map_item.damson_node_id);
+				work.pairs[work.pair_count++] = ((unsigned long long)n->node_map_item.interrupts[i] << 32) | n->node_map_item.damson_node_id;
 		}
-		n = n->next;
+	}
+	qsort(work.pairs, work.pair_count, sizeof(unsigned long long), CompareEdgePairs);
+	pthread_mutex_init(&work.lock, NULL);
+
+	//route every source then minimise every chip (all routes must be added before a table is minimised)
+	for (i=0; i<LOADER_ROUTE_THREADS; i++)
+		pthread_create(&threads[i], NULL, RouteWorker, &work);
+	for (i=0; i<LOADER_ROUTE_THREADS; i++)
+		pthread_join(threads[i], NULL);
+	for (i=0; i<LOADER_ROUTE_THREADS; i++)
+		pthread_create(&threads[i], NULL, MinimiseWorker, &work);
+	for (i=0; i<LOADER_ROUTE_THREADS; i++)
+		pthread_join(threads[i], NULL);
+	pthread_mutex_destroy(&work.lock);
+	free(work.pairs);
+
+	overflow = -1;
+	for (i=0; i<spinnaker_chips; i++){
+		if ((chips[i].rt_count > MAX_ROUTING_TABLE_ENTRIES) && (overflow < 0))
+			overflow = (int)i;
 	}
 
-	//cleanup link list
-	n = node_map_start;
-	while (n != NULL){
-		//iterate and remove mapping
-		temp = n->next;
-		free(n->node_map_item.interrupts);
-		free(n);
-		n = temp;
+	#if LOADER_DEBUG == 1
+		clock_gettime(CLOCK_MONOTONIC, &t2);
+		printf("\t\t[loader_debug] Routing tables of %d interrupts built in %ld ms\n", work.pair_count, (long)((t2.tv_sec - t1.tv_sec)*1000 + (t2.tv_nsec - t1.tv_nsec)/1000000));
+	#endif
+	return overflow;
+}
+
+/**
+ * Route thread, routes the next few sources until every source has been routed
+ */
+void* RouteWorker(void *arg)
+{
+	RouteWork *work = (RouteWork*)arg;
+	unsigned int *dst_ids;
+	unsigned int dst_size;
+	unsigned int start;
+	unsigned int end;
+	unsigned int i;
+	unsigned int j;
+
+	dst_size = 64;
+	dst_ids = (unsigned int*)malloc(dst_size*sizeof(unsigned int));
+	while (1){
+		//take the next sources (at least ROUTE_BATCH interrupts unless a single source has more)
+		pthread_mutex_lock(&work->lock);
+		start = work->next_pair;
+		for (end=start; (end<work->pair_count) && (end-start < ROUTE_BATCH); ){
+			for (j=end; (j<work->pair_count) && ((work->pairs[j] >> 32) == (work->pairs[end] >> 32)); j++);
+			end = j;
+		}
+		work->next_pair = end;
+		pthread_mutex_unlock(&work->lock);
+		if (start == end)
+			break;
+
+		//one multicast tree for all destinations of each source
+		for (i=start; i<end; i=j){
+			for (j=i; (j<end) && ((work->pairs[j] >> 32) == (work->pairs[i] >> 32)); j++){
+				if (j-i == dst_size){
+					dst_size *= 2;
+					dst_ids = (unsigned int*)realloc(dst_ids, dst_size*sizeof(unsigned int));
+				}
+				dst_ids[j-i] = (unsigned int)work->pairs[j];
+			}
+			RouteTree((unsigned int)(work->pairs[i] >> 32), dst_ids, j-i);
+		}
+	}
+	free(dst_ids);
+	return NULL;
+}
+
+/**
+ * Minimise thread, minimises (or orders) the routing table of the next chip until every chip has been minimised
+ */
+void* MinimiseWorker(void *arg)
+{
+	RouteWork *work = (RouteWork*)arg;
+	ChipConfig *c;
+	unsigned int chip;
+	#if (LOADER_MASKED_ROUTES == 1) && (LOADER_DEBUG == 1)
+		unsigned int entries;
+	#endif
+
+	while (1){
+		pthread_mutex_lock(&work->lock);
+		chip = work->next_chip++;
+		pthread_mutex_unlock(&work->lock);
+		if (chip >= spinnaker_chips)
+			break;
+
+		//the key index is only needed while routes are added
+		c = &chips[chip];
+		free(c->rt_index);
+		c->rt_index = NULL;
+		c->rt_index_size = 0;
+
+		#if LOADER_MASKED_ROUTES == 1
+			#if LOADER_DEBUG == 1
+				entries = c->rt_count;
+			#endif
+			MinimiseRoutingTable(c);
+			#if LOADER_DEBUG == 1
+				if (entries > 0)
+					printf("\t\t[loader_debug] Chip %d routing table minimised from %d to %d entries\n", chip, entries, c->rt_count);
+			#endif
+		#else
+			ExactRoutingTable(c);
+		#endif
 	}
+	return NULL;
 }
 
+/**
+ * Places nodes on chips in list order (16 nodes to a chip, chips in x then y order)
+ */
+void PlaceNodesLinear(unsigned int *chip_of)
+{
+	unsigned int i;
+	unsigned int chip;
+
+	for (i=0; i<node_count; i++){
+		chip = i / CHIP_NODE_CORES;
+		chip_of[i] = (chip / spinnaker_layout_width) + (chip % spinnaker_layout_width)*spinnaker_layout_width;
+	}
+}
+
+/**
+ * Places nodes on chips to minimise the interrupt traffic between chips (weighted hops). The interrupt graph is split by
+ * recursive bisection over halves of the machine (filling the half holding chip 0,0 first so that the nodes occupy a compact
+ * region) and the placement is then refined by simulated annealing. Returns 1 once placed.
+ */
+int PlaceNodes(unsigned int *chip_of, unsigned int table_budget)
+{
+	PlacementGraph g;
+	unsigned int *vertices;
+	unsigned int i;
+
+	BuildPlacementGraph(&g);
+	g.table_budget = table_budget;
+	vertices = (unsigned int*)malloc((g.vertices ? g.vertices : 1)*sizeof(unsigned int));
+	for (i=0; i<g.vertices; i++)
+		vertices[i] = i;
+
+	#if LOADER_DEBUG == 1
+		PlaceNodesLinear(g.chip);
+		printf("\t\t[loader_debug] Linear placement costs %u weighted hops\n", PlacementCost(&g));
+	#endif
+
+	BisectPlacement(&g, vertices, g.vertices, 0, 0, spinnaker_layout_width, spinnaker_layout_height);
+	#if LOADER_DEBUG == 1
+		printf("\t\t[loader_debug] Bisection placement costs %u weighted hops\n", PlacementCost(&g));
+	#endif
+	AnnealPlacement(&g);
+	#if LOADER_DEBUG == 1
+		printf("\t\t[loader_debug] Annealed placement costs %u weighted hops\n", PlacementCost(&g));
+	#endif
+
+	memcpy(chip_of, g.chip, g.vertices*sizeof(unsigned int));
+
+	free(vertices);
+	FreePlacementGraph(&g);
+	return 1;
+}
+
+/**
+ * Builds the interrupt graph of the node map list
+ */
+void BuildPlacementGraph(PlacementGraph *g)
+{
+	NodeMapItemList *n;
+	PlacementKey *sorted_ids;
+	PlacementKey key;
+	PlacementKey *found;
+	unsigned long long *pairs;
+	unsigned int pair_count;
+	unsigned int edges;
+	unsigned int i;
+	unsigned int j;
+	unsigned int v;
+	unsigned int u;
+
+	memset(g, 0, sizeof(PlacementGraph));
+	g->vertices = node_count;
+	g->ids = (unsigned int*)malloc((node_count+1)*sizeof(unsigned int));
+	g->chip = (unsigned int*)calloc(node_count+1, sizeof(unsigned int));
+	g->gain = (int*)calloc(node_count+1, sizeof(int));
+	g->side = (char*)calloc(node_count+1, sizeof(char));
+	g->mark = (unsigned int*)calloc(node_count+1, sizeof(unsigned int));
+	g->edge_start = (unsigned int*)calloc(node_count+1, sizeof(unsigned int));
+
+	//vertex of each node id (sorted for searching)
+	sorted_ids = (PlacementKey*)malloc((node_count+1)*sizeof(PlacementKey));
+	pair_count = 0;
+	for (n = node_map_start, v = 0; n != NULL; n = n->next, v++){
+		g->ids[v] = n->node_map_item.damson_node_id;
+		sorted_ids[v].key = (int)n->node_map_item.damson_node_id;
+		sorted_ids[v].vertex = v;
+		pair_count += n->node_map_item.num_interrupts;
+	}
+	qsort(sorted_ids, node_count, sizeof(PlacementKey), CompareNodeIds);
+
+	//directed edges from each interrupt source to the node (packed as source << 32 | destination)
+	pairs = (unsigned long long*)malloc((pair_count+1)*sizeof(unsigned long long));
+	pair_count = 0;
+	for (n = node_map_start, v = 0; n != NULL; n = n->next, v++){
+		for (i=0; i<n->node_map_item.num_interrupts; i++){
+			if (n->node_map_item.interrupts[i] == 0)	//timer interrupt
+				continue;
+			key.key = (int)n->node_map_item.interrupts[i];
+			found = (PlacementKey*)bsearch(&key, sorted_ids, node_count, sizeof(PlacementKey), CompareNodeIds);
+			if (found != NULL)
+				pairs[pair_count++] = ((unsigned long long)found->vertex << 32) | v;
+		}
+	}
+	free(sorted_ids);
+	qsort(pairs, pair_count, sizeof(unsigned long long), CompareEdgePairs);
+
+	//undirected weighted adjacency (every interrupt adds one to the weight of its edge)
+	edges = 0;
+	for (i=0; i<pair_count; i++){
+		u = (unsigned int)(pairs[i] >> 32);
+		v = (unsigned int)pairs[i];
+		if (u != v){
+			g->edge_start[u]++;
+			g->edge_start[v]++;
+			edges += 2;
+		}
+	}
+	for (i=0, j=0; i<=node_count; i++){	//counts to offsets of the end of each list
+		j += g->edge_start[i];
+		g->edge_start[i] = j;
+	}
+	g->edge_target = (unsigned int*)malloc((edges+1)*sizeof(unsigned int));
+	g->edge_weight = (unsigned int*)malloc((edges+1)*sizeof(unsigned int));
+	for (i=0; i<pair_count; i++){
+		u = (unsigned int)(pairs[i] >> 32);
+		v = (unsigned int)pairs[i];
+		if (u != v){
+			j = --g->edge_start[u];
+			g->edge_target[j] = v;
+			g->edge_weight[j] = 1;
+			j = --g->edge_start[v];
+			g->edge_target[j] = u;
+			g->edge_weight[j] = 1;
+		}
+	}
+	free(pairs);
+}
+
+void FreePlacementGraph(PlacementGraph *g)
+{
+	free(g->ids);
+	free(g->edge_start);
+	free(g->edge_target);
+	free(g->edge_weight);
+	free(g->chip);
+	free(g->gain);
+	free(g->side);
+	free(g->mark);
+}
+
+/**
+ * Places a set of vertices in a rectangle of chips by splitting it in two across its longer side (recursively)
+ */
+void BisectPlacement(PlacementGraph *g, unsigned int *vertices, unsigned int count, unsigned int x0, unsigned int y0, unsigned int width, unsigned int height)
+{
+	unsigned int x1, y1, width0, height0, width1, height1;
+	unsigned int size0;
+	unsigned int capacity0;
+	unsigned int i;
+	unsigned int j;
+	unsigned int t;
+
+	if (count == 0)
+		return;
+	if (width*height == 1){
+		for (i=0; i<count; i++)
+			g->chip[vertices[i]] = y0 + x0*spinnaker_layout_width;
+		return;
+	}
+
+	//the first half is the larger and holds chip 0,0 (when it holds the whole machine)
+	width0 = width;
+	height0 = height;
+	width1 = width;
+	height1 = height;
+	x1 = x0;
+	y1 = y0;
+	if (width >= height){
+		width0 = (width + 1) / 2;
+		width1 = width - width0;
+		x1 = x0 + width0;
+	}else{
+		height0 = (height + 1) / 2;
+		height1 = height - height0;
+		y1 = y0 + height0;
+	}
+
+	//fill the first half so that the nodes occupy as few chips as possible
+	capacity0 = width0*height0*CHIP_NODE_CORES;
+	size0 = (count < capacity0) ? count : capacity0;
+	if (size0 < count){
+		GrowBisection(g, vertices, count, size0);
+		RefineBisection(g, vertices, count);
+
+		//vertices of the first half to the front
+		for (i=0, j=count; i<j; ){
+			if (g->side[vertices[i]] == 0)
+				i++;
+			else{
+				j--;
+				t = vertices[i];
+				vertices[i] = vertices[j];
+				vertices[j] = t;
+			}
+		}
+	}
+
+	BisectPlacement(g, vertices, size0, x0, y0, width0, height0);
+	BisectPlacement(g, vertices + size0, count - size0, x1, y1, width1, height1);
+}
+
+/**
+ * Splits a set of vertices by growing the first part (size0 vertices) breadth first from a vertex at the edge of the graph
+ */
+void GrowBisection(PlacementGraph *g, unsigned int *vertices, unsigned int count, unsigned int size0)
+{
+	unsigned int *queue;
+	unsigned int head, tail;
+	unsigned int grown;
+	unsigned int seed;
+	unsigned int next;
+	unsigned int pass;
+	unsigned int i;
+	unsigned int e;
+	unsigned int u;
+	unsigned int v;
+
+	queue = (unsigned int*)malloc(count*sizeof(unsigned int));
+
+	//a breadth first search from any vertex ends at a vertex at the edge of its component
+	seed = vertices[0];
+	for (pass=0; pass<2; pass++){
+		g->stamp++;
+		for (i=0; i<count; i++){
+			g->mark[vertices[i]] = g->stamp;
+			g->side[vertices[i]] = 1;
+		}
+		g->stamp++;
+		head = tail = 0;
+		grown = 0;
+		next = 0;
+		queue[tail++] = seed;
+		g->mark[seed] = g->stamp;
+		while (grown < ((pass == 0) ? count : size0)){
+			if (head == tail){
+				//start a new component
+				while (g->mark[vertices[next]] == g->stamp)
+					next++;
+				queue[tail++] = vertices[next];
+				g->mark[vertices[next]] = g->stamp;
+			}
+			v = queue[head++];
+			if (pass == 1)
+				g->side[v] = 0;
+			grown++;
+			for (e=g->edge_start[v]; e<g->edge_start[v+1]; e++){
+				u = g->edge_target[e];
+				if (g->mark[u] == g->stamp - 1){	//in the set and not yet queued
+					g->mark[u] = g->stamp;
+					queue[tail++] = u;
+				}
+			}
+		}
+		seed = queue[tail-1];
+	}
+
+	//mark the set for refinement
+	g->stamp++;
+	for (i=0; i<count; i++)
+		g->mark[vertices[i]] = g->stamp;
+	free(queue);
+}
+
+/**
+ * Improves a split of a set of vertices (marked with the current stamp) by swapping pairs of vertices between the parts
+ * (the sizes of the parts do not change)
+ */
+void RefineBisection(PlacementGraph *g, unsigned int *vertices, unsigned int count)
+{
+	PlacementKey *part[2];
+	unsigned int part_size[2];
+	unsigned int pass;
+	unsigned int i, j;
+	unsigned int e;
+	unsigned int a, b, u;
+	unsigned int set;
+	int w;
+	int improved;
+
+	set = g->stamp;
+	part[0] = (PlacementKey*)malloc(count*sizeof(PlacementKey));
+	part[1] = (PlacementKey*)malloc(count*sizeof(PlacementKey));
+	for (pass=0; pass<8; pass++){
+		//gain of moving each vertex to the other part (external less internal weight)
+		part_size[0] = part_size[1] = 0;
+		for (i=0; i<count; i++){
+			a = vertices[i];
+			g->gain[a] = 0;
+			for (e=g->edge_start[a]; e<g->edge_start[a+1]; e++){
+				u = g->edge_target[e];
+				if (g->mark[u] == set)
+					g->gain[a] += (g->side[u] != g->side[a]) ? (int)g->edge_weight[e] : -(int)g->edge_weight[e];
+			}
+			part[(int)g->side[a]][part_size[(int)g->side[a]]].key = g->gain[a];
+			part[(int)g->side[a]][part_size[(int)g->side[a]]].vertex = a;
+			part_size[(int)g->side[a]]++;
+		}
+		qsort(part[0], part_size[0], sizeof(PlacementKey), ComparePlacementKeys);
+		qsort(part[1], part_size[1], sizeof(PlacementKey), ComparePlacementKeys);
+
+		//best candidates are at the end of each sorted part (stale gains are rechecked before swapping)
+		improved = 0;
+		g->stamp++;
+		i = part_size[0];
+		j = part_size[1];
+		while ((i > 0) && (j > 0)){
+			a = part[0][i-1].vertex;
+			b = part[1][j-1].vertex;
+			if (g->mark[a] != set){ i--; continue; }	//already swapped
+			if (g->mark[b] != set){ j--; continue; }
+			if (g->gain[a] + g->gain[b] <= 0)
+				break;
+			w = 0;
+			for (e=g->edge_start[a]; e<g->edge_start[a+1]; e++)
+				if (g->edge_target[e] == b)
+					w += g->edge_weight[e];
+			if (g->gain[a] + g->gain[b] - 2*w > 0){
+				//swap and update the gains of the neighbours
+				g->side[a] = 1;
+				g->side[b] = 0;
+				for (e=g->edge_start[a]; e<g->edge_start[a+1]; e++){
+					u = g->edge_target[e];
+					if (g->mark[u] == set)
+						g->gain[u] += (g->side[u] == 0) ? 2*(int)g->edge_weight[e] : -2*(int)g->edge_weight[e];
+				}
+				for (e=g->edge_start[b]; e<g->edge_start[b+1]; e++){
+					u = g->edge_target[e];
+					if (g->mark[u] == set)
+						g->gain[u] += (g->side[u] == 1) ? 2*(int)g->edge_weight[e] : -2*(int)g->edge_weight[e];
+				}
+				g->mark[a] = g->stamp;	//locked for the rest of the pass
+				g->mark[b] = g->stamp;
+				improved = 1;
+				i--;
+				j--;
+			}else if (g->gain[a] < g->gain[b])
+				i--;
+			else
+				j--;
+		}
+
+		//unlock
+		for (i=0; i<count; i++)
+			g->mark[vertices[i]] = set;
+		g->stamp = set;
+		if (!improved)
+			break;
+	}
+	free(part[0]);
+	free(part[1]);
+}
+
+/**
+ * Refines a placement by simulated annealing (moves to free cores and swaps between chips). The cost is the weighted hops
+ * plus ANNEAL_TABLE_PENALTY for each edge leaving a chip over the table budget, so that no routing table is filled up.
+ */
+void AnnealPlacement(PlacementGraph *g)
+{
+	unsigned int chips_count;
+	unsigned int total_moves;
+	unsigned int *chip_load;
+	unsigned int *chip_vertices;	//CHIP_NODE_CORES slots per chip
+	unsigned int *slot;				//slot of each vertex
+	unsigned int moves;
+	unsigned int step;
+	unsigned int accepted;
+	unsigned int m;
+	unsigned int v, u;
+	unsigned int from, to;
+	unsigned int i;
+	double temperature;
+	double total;
+	int delta;
+
+	if ((g->vertices < 2) || (g->edge_start[g->vertices] == 0))
+		return;
+
+	//chips are indexed y + x*width so the index range covers every chip of the layout
+	chips_count = (spinnaker_layout_width-1)*spinnaker_layout_width + spinnaker_layout_height;
+	chip_load = (unsigned int*)calloc(chips_count, sizeof(unsigned int));
+	chip_vertices = (unsigned int*)malloc(chips_count*CHIP_NODE_CORES*sizeof(unsigned int));
+	slot = (unsigned int*)malloc(g->vertices*sizeof(unsigned int));
+	g->chip_edges = (unsigned int*)calloc(chips_count, sizeof(unsigned int));
+	g->chip_change = (int*)calloc(chips_count, sizeof(int));
+	g->touched = (unsigned int*)malloc(chips_count*sizeof(unsigned int));
+	g->listed = (char*)calloc(chips_count, sizeof(char));
+	g->touched_count = 0;
+	for (v=0; v<g->vertices; v++){
+		slot[v] = g->chip[v]*CHIP_NODE_CORES + chip_load[g->chip[v]];
+		chip_vertices[slot[v]] = v;
+		chip_load[g->chip[v]]++;
+		for (i=g->edge_start[v]; i<g->edge_start[v+1]; i++)
+			if (g->chip[g->edge_target[i]] != g->chip[v])
+				g->chip_edges[g->chip[v]]++;
+	}
+
+	//initial temperature from the size of random moves
+	total = 0;
+	for (m=0; m<100; m++){
+		v = PlacementRandom(g->vertices);
+		delta = PlacementDelta(g, v, PlacementRandom(spinnaker_layout_height) + PlacementRandom(spinnaker_layout_width)*spinnaker_layout_width, g->vertices);
+		total += (delta < 0) ? -delta : delta;
+	}
+	temperature = total / 100;
+
+	//the moves in proportion to the nodes are shared out over the steps (capped so that large graphs finish)
+	total_moves = (g->vertices > ANNEAL_MAX_MOVES/ANNEAL_MOVES_PER_NODE) ? ANNEAL_MAX_MOVES : g->vertices*ANNEAL_MOVES_PER_NODE;
+	moves = total_moves / ANNEAL_MAX_STEPS;
+	for (step=0; (step<ANNEAL_MAX_STEPS) && (temperature > 0.01); step++){
+		accepted = 0;
+		for (m=0; m<moves; m++){
+			v = PlacementRandom(g->vertices);
+			from = g->chip[v];
+
+			//move next to a neighbour most of the time (random chips let the placement escape local minima)
+			if ((g->edge_start[v+1] > g->edge_start[v]) && (PlacementRandom(4) != 0))
+				to = g->chip[g->edge_target[g->edge_start[v] + PlacementRandom(g->edge_start[v+1] - g->edge_start[v])]];
+			else
+				to = PlacementRandom(spinnaker_layout_height) + PlacementRandom(spinnaker_layout_width)*spinnaker_layout_width;
+			if (to == from)
+				continue;
+
+			//swap with a node of the chip unless it has a free core
+			u = g->vertices;
+			if ((chip_load[to] == CHIP_NODE_CORES) || ((chip_load[to] > 0) && PlacementRandom(2)))
+				u = chip_vertices[to*CHIP_NODE_CORES + PlacementRandom(chip_load[to])];
+
+			//chip 0,0 must keep a node
+			if ((u == g->vertices) && (from == 0) && (chip_load[0] == 1))
+				continue;
+
+			delta = PlacementDelta(g, v, to, u) + TableDelta(g, v, to, u);
+			if ((delta > 0) && (exp(-delta / temperature) * 4294967295.0 <= (double)PlacementRandom(0xffffffff))){
+				EndTableDelta(g, 0);
+				continue;
+			}
+
+			//apply
+			EndTableDelta(g, 1);
+			accepted++;
+			if (u == g->vertices){
+				i = chip_vertices[from*CHIP_NODE_CORES + chip_load[from] - 1];	//last of the old chip fills the hole
+				chip_vertices[slot[v]] = i;
+				slot[i] = slot[v];
+				chip_load[from]--;
+				slot[v] = to*CHIP_NODE_CORES + chip_load[to];
+				chip_vertices[slot[v]] = v;
+				chip_load[to]++;
+				g->chip[v] = to;
+			}else{
+				i = slot[v];
+				slot[v] = slot[u];
+				slot[u] = i;
+				chip_vertices[slot[v]] = v;
+				chip_vertices[slot[u]] = u;
+				g->chip[v] = to;
+				g->chip[u] = from;
+			}
+		}
+		if (accepted == 0)
+			break;
+		temperature *= ANNEAL_COOLING;
+	}
+
+	free(chip_load);
+	free(chip_vertices);
+	free(slot);
+	free(g->chip_edges);
+	free(g->chip_change);
+	free(g->touched);
+	free(g->listed);
+	g->chip_edges = NULL;
+	g->chip_change = NULL;
+	g->touched = NULL;
+	g->listed = NULL;
+}
+
+/**
+ * Change in weighted hops from moving a vertex to a chip (swapping it with vertex other unless other is g->vertices)
+ */
+int PlacementDelta(PlacementGraph *g, unsigned int v, unsigned int chip, unsigned int other)
+{
+	unsigned int from;
+	unsigned int e;
+	unsigned int u;
+	int delta;
+
+	from = g->chip[v];
+	delta = 0;
+	for (e=g->edge_start[v]; e<g->edge_start[v+1]; e++){
+		u = g->edge_target[e];
+		if (u != other)		//the distance between swapped vertices does not change
+			delta += (int)g->edge_weight[e] * ((int)PlacementDistance(chip, g->chip[u]) - (int)PlacementDistance(from, g->chip[u]));
+	}
+	if (other != g->vertices){
+		for (e=g->edge_start[other]; e<g->edge_start[other+1]; e++){
+			u = g->edge_target[e];
+			if (u != v)
+				delta += (int)g->edge_weight[e] * ((int)PlacementDistance(from, g->chip[u]) - (int)PlacementDistance(chip, g->chip[u]));
+		}
+	}
+	return delta;
+}
+
+/**
+ * Change in the table penalty from moving a vertex to a chip (swapping it with vertex other unless other is g->vertices). The
+ * change in the edges leaving each chip is held until EndTableDelta() applies or drops it.
+ */
+int TableDelta(PlacementGraph *g, unsigned int v, unsigned int chip, unsigned int other)
+{
+	unsigned int from;
+	unsigned int i;
+	unsigned int c;
+	int before, after;
+	int delta;
+
+	from = g->chip[v];
+	MoveTableEdges(g, v, from, chip, other);
+	if (other != g->vertices)
+		MoveTableEdges(g, other, chip, from, v);
+
+	//only edges over the budget of a chip are penalised
+	delta = 0;
+	for (i=0; i<g->touched_count; i++){
+		c = g->touched[i];
+		before = (int)g->chip_edges[c] - (int)g->table_budget;
+		after = before + g->chip_change[c];
+		delta += ((after > 0) ? after : 0) - ((before > 0) ? before : 0);
+	}
+	return delta * ANNEAL_TABLE_PENALTY;
+}
+
+/**
+ * Counts the change in the edges leaving each chip from moving a vertex between chips (the edge to other moves with it)
+ */
+void MoveTableEdges(PlacementGraph *g, unsigned int v, unsigned int from, unsigned int to, unsigned int other)
+{
+	unsigned int e;
+	unsigned int c;
+
+	for (e=g->edge_start[v]; e<g->edge_start[v+1]; e++){
+		if (g->edge_target[e] == other)
+			continue;
+		c = g->chip[g->edge_target[e]];
+		if (c != from){
+			ChangeTableEdges(g, from, -1);
+			ChangeTableEdges(g, c, -1);
+		}
+		if (c != to){
+			ChangeTableEdges(g, to, 1);
+			ChangeTableEdges(g, c, 1);
+		}
+	}
+}
+
+void ChangeTableEdges(PlacementGraph *g, unsigned int chip, int change)
+{
+	//a chip is listed once however many edges it gains or loses
+	if (!g->listed[chip]){
+		g->listed[chip] = 1;
+		g->touched[g->touched_count++] = chip;
+	}
+	g->chip_change[chip] += change;
+}
+
+/**
+ * Applies (or drops) the change in the edges leaving each chip counted by TableDelta()
+ */
+void EndTableDelta(PlacementGraph *g, int apply)
+{
+	unsigned int i;
+	unsigned int c;
+
+	for (i=0; i<g->touched_count; i++){
+		c = g->touched[i];
+		if (apply)
+			g->chip_edges[c] += g->chip_change[c];
+		g->chip_change[c] = 0;
+		g->listed[c] = 0;
+	}
+	g->touched_count = 0;
+}
+
+/**
+ * Total weighted hops of a placement
+ */
+unsigned int PlacementCost(PlacementGraph *g)
+{
+	unsigned int cost;
+	unsigned int v;
+	unsigned int e;
+
+	cost = 0;
+	for (v=0; v<g->vertices; v++)
+		for (e=g->edge_start[v]; e<g->edge_start[v+1]; e++)
+			cost += g->edge_weight[e] * PlacementDistance(g->chip[v], g->chip[g->edge_target[e]]);
+	return cost / 2;	//every edge is held by both vertices
+}
+
+/**
+ * Hops between two chips (y + x*width)
+ */
+unsigned int PlacementDistance(unsigned int chip0, unsigned int chip1)
+{
+	return ChipDistance(chip0 / spinnaker_layout_width, chip0 % spinnaker_layout_width, chip1 / spinnaker_layout_width, chip1 % spinnaker_layout_width);
+}
+
+/**
+ * Pseudo random number in [0,n) (xorshift)
+ */
+unsigned int PlacementRandom(unsigned int n)
+{
+	placement_seed ^= placement_seed << 13;
+	placement_seed ^= placement_seed >> 17;
+	placement_seed ^= placement_seed << 5;
+	return (n == 0) ? 0 : (placement_seed % n);
+}
+
+int ComparePlacementKeys(const void *a, const void *b)
+{
+	const PlacementKey *ka = (const PlacementKey*)a;
+	const PlacementKey *kb = (const PlacementKey*)b;
+
+	if (ka->key != kb->key)
+		return (ka->key < kb->key) ? -1 : 1;
+	return (ka->vertex < kb->vertex) ? -1 : (ka->vertex > kb->vertex);
+}
+
+int CompareNodeIds(const void *a, const void *b)
+{
+	unsigned int ia = (unsigned int)((const PlacementKey*)a)->key;
+	unsigned int ib = (unsigned int)((const PlacementKey*)b)->key;
+
+	return (ia < ib) ? -1 : (ia > ib);
+}
+
+int CompareEdgePairs(const void *a, const void *b)
+{
+	unsigned long long ua = *(const unsigned long long*)a;
+	unsigned long long ub = *(const unsigned long long*)b;
+
+	return (ua < ub) ? -1 : (ua > ub);
+}
 
 void LoadNode(unsigned int    node,
 			  char            *prototype_object_name,
@@ -258,7 +1414,122 @@ void LoadNode(unsigned int    node,
 			  RuntimeLogItem  *snapshots,unsigned int num_snapshots,
 			  int debug_mode)
 {
-	InterruptVector *InterruptHash;
+	LoadJob *job;
+	unsigned int i;
+
+	pthread_mutex_lock(&load_queue_lock);
+
+	//workers share the transports so that transfers of many nodes (on different cores and chips) are in flight at once
+	if (!load_workers_started)
+	{
+		#if LOADER_INCREMENTAL == 1
+			ReadShadow();
+		#endif
+		for (i=0; i<LOADER_WORKERS; i++)
+			pthread_create(&load_workers[i], NULL, LoadWorker, NULL);
+		load_workers_started = 1;
+	}
+
+	//prototypes are placed in the order nodes are queued so that a reload places them as before
+	#if LOADER_SHARED_PROTOTYPES == 1
+		AllocatePrototype(node, prototype_object_name);
+	#endif
+
+	//wait for space in the queue (bounds the memory held by copies of the vectors)
+	while (load_queue_count == LOAD_QUEUE_SIZE)
+		pthread_cond_wait(&load_queue_not_full, &load_queue_lock);
+
+	job = &load_queue[(load_queue_head + load_queue_count) % LOAD_QUEUE_SIZE];
+	job->node = node;
+	strncpy(job->prototype_object_name, prototype_object_name, MAX_STRING_SIZE-1);
+	job->prototype_object_name[MAX_STRING_SIZE-1] = '\0';
+	job->gv = (int*)CopyVector(gv, gvusersize*sizeof(int));
+	job->gvusersize = gvusersize;
+	job->ev = (int*)CopyVector(ev, evsize*sizeof(int));
+	job->evsize = evsize;
+	job->intv = (InterruptVector*)CopyVector(intv, intvsize*sizeof(InterruptVector));
+	job->intvsize = intvsize;
+	job->logs = (RuntimeLogItem*)CopyVector(logs, num_logs*sizeof(RuntimeLogItem));
+	job->num_logs = num_logs;
+	job->snapshots = (RuntimeLogItem*)CopyVector(snapshots, num_snapshots*sizeof(RuntimeLogItem));
+	job->num_snapshots = num_snapshots;
+	job->debug_mode = debug_mode;
+	load_queue_count++;
+
+	pthread_cond_signal(&load_queue_not_empty);
+	pthread_mutex_unlock(&load_queue_lock);
+}
+
+void CachePrototype(unsigned int node, char *prototype_object_name)
+{
+	//each prototype is mapped once and shared by every node which runs it
+	if (!spiNN_cache_file(prototype_object_name, NULL, NULL))
+	{
+		printf("Error: Damson protoype program '%s' for node %d not found! Have you linked it!\n", prototype_object_name, node);
+		exit(0);
+	}
+}
+
+void FinishLoading()
+{
+	unsigned int i;
+
+	if (!load_workers_started)
+		return;
+
+	//workers exit once the queue is empty
+	pthread_mutex_lock(&load_queue_lock);
+	loading_finished = 1;
+	pthread_cond_broadcast(&load_queue_not_empty);
+	pthread_mutex_unlock(&load_queue_lock);
+
+	for (i=0; i<LOADER_WORKERS; i++)
+		pthread_join(load_workers[i], NULL);
+	load_workers_started = 0;
+	loading_finished = 0;
+
+	//a failed load is not recorded in the shadow
+	if (verify_failures > 0)
+	{
+		printf("Error: %u nodes failed verification\n", verify_failures);
+		exit(0);
+	}
+
+	#if LOADER_INCREMENTAL == 1
+		WriteShadow();
+	#endif
+	for (i=0; i<spinnaker_chips; i++)
+	{
+		free(chips[i].tables);
+		free(chips[i].table_hashes);
+		free(chips[i].shadow.table_hashes);
+		chips[i].tables = NULL;
+		chips[i].table_hashes = NULL;
+		chips[i].shadow.table_hashes = NULL;
+	}
+}
+
+/**
+ * Loads a queued node (called by a load worker). Nodes do not share device memory apart from the core map and routing table
+ * which are only written by the node on core 1 of each chip, and every node has its own staging area, so loads need no
+ * ordering between them. Everything they write is complete once FinishLoading() returns (i.e. before any core is started).
+ */
+void LoadQueuedNode(LoadJob *job, NodeTransfers *transfers)
+{
+	unsigned int    node = job->node;
+	char            *prototype_object_name = job->prototype_object_name;
+	int             *gv = job->gv;
+	unsigned int    gvusersize = job->gvusersize;
+	int             *ev = job->ev;
+	unsigned int    evsize = job->evsize;
+	InterruptVector *intv = job->intv;
+	unsigned int    intvsize = job->intvsize;
+	RuntimeLogItem  *logs = job->logs;
+	unsigned int    num_logs = job->num_logs;
+	RuntimeLogItem  *snapshots = job->snapshots;
+	unsigned int    num_snapshots = job->num_snapshots;
+	int             debug_mode = job->debug_mode;
+	unsigned int *dtcm_image;
 	HardwareMapping map;
 	SpiNN_address node_address;
 	SpiNN_chip_address chip_address;
@@ -278,6 +1549,11 @@ void LoadNode(unsigned int    node,
 	unsigned int snapshots_start;
 	unsigned int logs_size_bytes;
 	unsigned int snapshots_size_bytes;
+	spiNN_context *context;
+	spiNN_table *init_table;
+	int ev_in_table;
+	unsigned int prototype_address;
+	unsigned int prototype_size;
 
 	gv_user_size_bytes = gvusersize *sizeof(int);
 	gv_size_words = gvusersize + DAMSONRT_SYSTEM_RESERVED;
@@ -309,83 +1585,426 @@ void LoadNode(unsigned int    node,
 	chip_address.x = node_address.x;
 	chip_address.y = node_address.y;
 	chip = chip_address.y + (chip_address.x*spinnaker_layout_width);
+	context = GetContext(node_address);
+
+
+	//get the ev start address based on the core number and update the aplx header
+	ev_start = DAMSONRT_EV_START(node_address.core_id);
+
+	//the program is sent once per chip and copied on chip to each core which runs it
+	prototype_address = 0;
+	prototype_size = 0;
+	#if LOADER_SHARED_PROTOTYPES == 1
+		prototype_address = SharePrototype(context, node_address, chip, prototype_object_name, node, &prototype_size);
+	#endif
+
+	//build the complete dtcm data part in host memory (system globals, user globals, interrupt vector, logs and snapshots)
+	dtcm_image = (unsigned int*) calloc(1, dtcm_data_size);
+	dtcm_image[0] = gv_size_words;			//0 = gv size (user + reserved)
+	dtcm_image[5] = intv_hash_size;			//5 = intv size (number of entries)
+	dtcm_image[8] = num_logs;				//8 = log count
+	dtcm_image[9] = num_snapshots;			//9 = snapshot count
+	dtcm_image[24] = debug_mode;			//24 = debug mode
+	dtcm_image[40] = intv_start;			//40 = intv start
+	dtcm_image[43] = logs_start;			//43 = start address of logs
+	dtcm_image[44] = snapshots_start;		//44 = start address of snapshots
+	dtcm_image[48] = spinnaker_chips;		//48 = chip count
+	dtcm_image[49] = node;					//49 = node number
+	memcpy((char*)dtcm_image + (gv_user_start - gv_start), gv, gv_user_size_bytes);
+	BuildDeviceIntVector((InterruptVector*)((char*)dtcm_image + (intv_start - gv_start)), intv, intvsize);
+	memcpy((char*)dtcm_image + (logs_start - gv_start), logs, logs_size_bytes);
+	memcpy((char*)dtcm_image + (snapshots_start - gv_start), snapshots, snapshots_size_bytes);
+
+	//one aplx table per core clears memory and then copies the dtcm image, program and ev into place from its staging area
+	//(repeated values and blocks are expanded on chip and never sent)
+	for (ev_in_table = 1; ev_in_table >= 0; ev_in_table--)
+	{
+		init_table = spiNN_create_table(LOADER_STAGING_START(node_address.core_id));
+		spiNN_table_fill(init_table, DAMSONRT_DTCM_START, dtcm_data_size, 0);		//data part of dtcm (not the stacks)
+		spiNN_table_fill(init_table, ev_start, ev_size_bytes+sizeof(int), 0);		//external vector (extra value is evsize)
+		spiNN_table_data(init_table, (char*)dtcm_image, gv_start, dtcm_data_size);
+		spiNN_table_data(init_table, (char*)&evsize, ev_start, sizeof(unsigned int));
+		//load program to non data part of DTCM (start of space reserved for stack at runtime)
+		if (prototype_address)
+			spiNN_table_copy(init_table, DAMSONRT_DTCM_PROGRAM_START, prototype_address, prototype_size);
+		else if (!spiNN_table_file(init_table, prototype_object_name, DAMSONRT_DTCM_PROGRAM_START))
+		{
+			printf("Error: Damson protoype program '%s' for node %d not found! Have you linked it!\n", prototype_object_name, node);
+			exit(0);
+		}
+		if (ev_in_table)
+			spiNN_table_data(init_table, (char*)ev, ev_start+sizeof(unsigned int), ev_size_bytes);
+
+		//too large to stage with the ev so it is written afterwards
+		if ((!ev_in_table) || (spiNN_table_size(init_table) <= LOADER_STAGING_SIZE))
+			break;
+		spiNN_free_table(init_table);
+	}
+	//completes once the table has finished running on the core
+	CheckTransfer(spiNN_run_table(context, node_address, init_table), node, "run memory init table");
+
+	//intelligently write ev to device (i.e. only non zero parts) unless the init table has already expanded it
+	if (!ev_in_table)
+		QueueTransfer(transfers, context, spiNN_write_compressed_memory_async(context, node_address, (char*)ev, ev_start+sizeof(unsigned int), evsize*sizeof(int), LOADER_STAGING_START(node_address.core_id), LOADER_STAGING_SIZE, NULL, NULL), node, "write external vector"); //gv offset by 4 bytes (expanded on chip if cheaper)
+
+
+	//load core map and routing table to sdram if first core from the chip (i.e. core_id == 1)
+	if (node_address.core_id == 1)
+		WriteChipTables(transfers, context, node_address, chip, node);
+
+	//transfers overlap in the event loop (host buffers must stay valid until they complete)
+	WaitTransfers(transfers, node);
+
+	#if LOADER_DEBUG == 1
+		printf("\t\t[loader_debug] Node (%u) loaded '%s' to SpiNNaker(%d,%d,%d)\n", node, prototype_object_name, node_address.x, node_address.y, node_address.core_id);
+	#endif
+	#if (LOADER_VERIFY == 1) || (LOADER_DEBUG == 1)
+		//a node which fails is reported once every worker has finished (workers do not exit the loader)
+		if (!CheckNodeMemory(node, gv, gvusersize, ev, evsize, intv, intvsize, logs, num_logs, snapshots, num_snapshots))
+		{
+			pthread_mutex_lock(&load_queue_lock);
+			verify_failures++;
+			pthread_mutex_unlock(&load_queue_lock);
+		}
+	#endif
+
+	//free dtcm image
+	free(dtcm_image);
+
+}
+
+/**
+ * Places a prototype in the shared SDRAM of the chip of a node (unless it is already there or the prototype area of the chip is full)
+ */
+void AllocatePrototype(unsigned int node, char *prototype_object_name)
+{
+	HardwareMapping map;
+	SpiNN_address node_address;
+	ChipConfig *c;
+	ChipPrototype *prototype;
+	unsigned int chip;
+	unsigned int file_size;
+	unsigned int content_hash;
+	unsigned int i;
+
+	map = GetMapping(node);
+	node_address = GetSpiNNAddress(map.spinnaker_id);
+	chip = node_address.y + (node_address.x*spinnaker_layout_width);
+	c = &chips[chip];
+
+	if (!spiNN_cache_file(prototype_object_name, &file_size, &content_hash))
+	{
+		printf("Error: Damson protoype program '%s' for node %d not found! Have you linked it!\n", prototype_object_name, node);
+		exit(0);
+	}
+	file_size = (file_size + 3) & ~3;
+
+	pthread_mutex_lock(&prototype_lock);
+	for (i=0; i<c->prototype_count; i++)
+	{
+		if (strcmp(c->prototypes[i].name, prototype_object_name) == 0)
+		{
+			pthread_mutex_unlock(&prototype_lock);
+			return;
+		}
+	}
+	if ((c->prototype_count == MAX_CHIP_PROTOTYPES) || (c->prototype_area_used + file_size > LOADER_PROTOTYPE_AREA_SIZE))
+	{
+		pthread_mutex_unlock(&prototype_lock);
+		return;
+	}
+	prototype = &c->prototypes[c->prototype_count++];
+	strncpy(prototype->name, prototype_object_name, MAX_STRING_SIZE-1);
+	prototype->content_hash = content_hash;
+	prototype->address = LOADER_PROTOTYPE_START + c->prototype_area_used;
+	prototype->size = file_size;
+	prototype->state = PROTOTYPE_UNWRITTEN;
+	c->prototype_area_used += file_size;
+
+	//the previous load may have left the same program in the same place
+	if (c->shadow_valid)
+	{
+		for (i=0; i<c->shadow.prototype_count; i++)
+		{
+			if ((c->shadow.prototypes[i].content_hash == content_hash) && (c->shadow.prototypes[i].address == prototype->address) &&
+				(c->shadow.prototypes[i].size == file_size))
+				prototype->state = PROTOTYPE_WRITTEN;
+		}
+	}
+	pthread_mutex_unlock(&prototype_lock);
+}
+
+/**
+ * Gets the shared SDRAM copy of a prototype on the chip of a node, writing it if this is the first node on the chip
+ * to run the prototype (returns 0 if the prototype did not fit in the prototype area of the chip)
+ */
+unsigned int SharePrototype(spiNN_context *context, SpiNN_address node_address, unsigned int chip, char *prototype_object_name, unsigned int node, unsigned int *size)
+{
+	ChipPrototype *prototype;
+	spiNN_table *table;
+	unsigned int i;
 
+	pthread_mutex_lock(&prototype_lock);
+	prototype = NULL;
+	for (i=0; i<chips[chip].prototype_count; i++)
+	{
+		if (strcmp(chips[chip].prototypes[i].name, prototype_object_name) == 0)
+			prototype = &chips[chip].prototypes[i];
+	}
+	if (prototype == NULL)
+	{
+		pthread_mutex_unlock(&prototype_lock);
+		return 0;
+	}
 
-	//get the ev start address based on the core number and update the aplx header
-	ev_start = DAMSONRT_EV_START(node_address.core_id);
+	//another core of the chip may still be writing it
+	while (prototype->state == PROTOTYPE_WRITING)
+		pthread_cond_wait(&prototype_written, &prototype_lock);
+	*size = prototype->size;
+	if (prototype->state == PROTOTYPE_WRITTEN)
+	{
+		pthread_mutex_unlock(&prototype_lock);
+		return prototype->address;
+	}
+	prototype->state = PROTOTYPE_WRITING;
+	pthread_mutex_unlock(&prototype_lock);
 
-	//aplx header for filling areas of spinnaker memory (APLX_FILL, start address, length, value)
-	unsigned int init_aplx[12] = {0x00000003, DAMSONRT_DTCM_START, dtcm_data_size,   			0x00000000, //data part of dtcm (not the stacks)
-								  0x00000003, ev_start,            ev_size_bytes+sizeof(int),	0x00000000,	//external vector (extra value is evsize)
-								  0xffffffff, 0x00000000,          0x00000000,           		0x00000000};
-	//write to system memory and execute
-	spiNN_write_memory(node_address, (char *)init_aplx, 0xf5000000, sizeof(init_aplx));
-	spiNN_start_application_at(node_address, 0xf5000000);
-	usleep(10000); //need to sleep for enough time to let aplx complete or there will be validation errors!
+	//written with this core's staging area (which is not yet in use by its own load)
+	table = spiNN_create_table(LOADER_STAGING_START(node_address.core_id));
+	spiNN_table_file(table, prototype_object_name, prototype->address);
+	CheckTransfer(spiNN_run_table(context, node_address, table), node, "write shared prototype");
 
+	pthread_mutex_lock(&prototype_lock);
+	prototype->state = PROTOTYPE_WRITTEN;
+	pthread_cond_broadcast(&prototype_written);
+	pthread_mutex_unlock(&prototype_lock);
 
-	//build interrupt vector
-	InterruptHash = (InterruptVector*) malloc(intv_hash_size_bytes);
-	BuildDeviceIntVector(InterruptHash, intv, intvsize);
+	return prototype->address;
+}
 
-	//write system globals
-	spiNN_write_memory(node_address, (char*)&gv_size_words, 		(unsigned int)DAMSONRT_SYSTEM_GLOBAL_ADDRESS(0), sizeof(unsigned int));		//0 = gv size (user + reserved)
-	spiNN_write_memory(node_address, (char*)&intv_hash_size, 		(unsigned int)DAMSONRT_SYSTEM_GLOBAL_ADDRESS(5), sizeof(unsigned int));		//5 = intv size (number of entries)
+/**
+ * Writes the core map and routing table of a chip to the start of its shared SDRAM (only blocks which differ from the shadow)
+ */
+void WriteChipTables(NodeTransfers *transfers, spiNN_context *context, SpiNN_address node_address, unsigned int chip, unsigned int node)
+{
+	ChipConfig *c;
+	#if LOADER_MASKED_ROUTES == 1
+		unsigned int format;
+	#else
+		ExactRoutingEntry *exact;
+	#endif
+	unsigned int i;
+	unsigned int end;
+	unsigned int size;
+
+	//core map, routing table format (masked tables), number of routing table values and routing table (kept until the shadow is written)
+	c = &chips[chip];
+	#if LOADER_MASKED_ROUTES == 1
+		format = DAMSONRT_ROUTING_TABLE_FORMAT;
+		c->table_size = spinnaker_chips*sizeof(unsigned int) + 2*sizeof(unsigned int) + c->rt_count*sizeof(RoutingEntry);
+		c->tables = (char*)malloc(c->table_size);
+		memcpy(c->tables, core_map, spinnaker_chips*sizeof(unsigned int));
+		memcpy(c->tables + spinnaker_chips*sizeof(unsigned int), &format, sizeof(unsigned int));
+		memcpy(c->tables + spinnaker_chips*sizeof(unsigned int) + sizeof(unsigned int), &c->rt_count, sizeof(unsigned int));
+		memcpy(c->tables + spinnaker_chips*sizeof(unsigned int) + 2*sizeof(unsigned int), c->rt, c->rt_count*sizeof(RoutingEntry));
+	#else
+		c->table_size = spinnaker_chips*sizeof(unsigned int) + sizeof(unsigned int) + c->rt_count*sizeof(ExactRoutingEntry);
+		c->tables = (char*)malloc(c->table_size);
+		memcpy(c->tables, core_map, spinnaker_chips*sizeof(unsigned int));
+		memcpy(c->tables + spinnaker_chips*sizeof(unsigned int), &c->rt_count, sizeof(unsigned int));
+		exact = (ExactRoutingEntry*)(c->tables + spinnaker_chips*sizeof(unsigned int) + sizeof(unsigned int));
+		for (i=0; i<c->rt_count; i++){
+			exact[i].key = c->rt[i].key;
+			exact[i].route = c->rt[i].route;
+		}
+	#endif
 
-	spiNN_write_memory(node_address, (char*)&num_logs,    			(unsigned int)DAMSONRT_SYSTEM_GLOBAL_ADDRESS(8), sizeof(unsigned int));		//8 = log count
-	spiNN_write_memory(node_address, (char*)&num_snapshots,   		(unsigned int)DAMSONRT_SYSTEM_GLOBAL_ADDRESS(9), sizeof(unsigned int));		//9 = snapshot count
+	c->table_blocks = (c->table_size + LOADER_SHADOW_BLOCK - 1) / LOADER_SHADOW_BLOCK;
+	c->table_hashes = (unsigned int*)malloc(c->table_blocks*sizeof(unsigned int));
+	for (i=0; i<c->table_blocks; i++)
+	{
+		size = c->table_size - i*LOADER_SHADOW_BLOCK;
+		c->table_hashes[i] = HashBlock(c->tables + i*LOADER_SHADOW_BLOCK, (size < LOADER_SHADOW_BLOCK) ? size : LOADER_SHADOW_BLOCK);
+	}
 
-	spiNN_write_memory(node_address, (char*)&intv_start,     		(unsigned int)DAMSONRT_SYSTEM_GLOBAL_ADDRESS(40), sizeof(unsigned int));		//40 = intv start
-	spiNN_write_memory(node_address, (char*)&logs_start,    		(unsigned int)DAMSONRT_SYSTEM_GLOBAL_ADDRESS(43), sizeof(unsigned int));		//43 = start address of logs
-	spiNN_write_memory(node_address, (char*)&snapshots_start,   	(unsigned int)DAMSONRT_SYSTEM_GLOBAL_ADDRESS(44), sizeof(unsigned int));		//44 = start address of snapshots
+	//each run of changed blocks is a single write
+	for (i=0; i<c->table_blocks; i=end)
+	{
+		for (end=i; end<c->table_blocks; end++)
+		{
+			if (c->shadow_valid && (end < c->shadow.table_blocks) && (c->table_hashes[end] == c->shadow.table_hashes[end]))
+				break;
+		}
+		if (end == i)
+		{
+			end++;
+			continue;
+		}
+		size = ((end == c->table_blocks) ? c->table_size : end*LOADER_SHADOW_BLOCK) - i*LOADER_SHADOW_BLOCK;
+		QueueTransfer(transfers, context, spiNN_write_memory_async(context, node_address, c->tables + i*LOADER_SHADOW_BLOCK, DAMSONRT_EV_SHARED_START + i*LOADER_SHADOW_BLOCK, size, NULL, NULL), node, "write core map and routing table");
+	}
+}
 
-	spiNN_write_memory(node_address, (char*)&spinnaker_chips,  		(unsigned int)DAMSONRT_SYSTEM_GLOBAL_ADDRESS(48), sizeof(unsigned int));		//48 = chip count
-	spiNN_write_memory(node_address, (char*)&node,           		(unsigned int)DAMSONRT_SYSTEM_GLOBAL_ADDRESS(49), sizeof(unsigned int));		//49 = node number
+/**
+ * 32 bit FNV-1a hash of a block of bytes
+ */
+unsigned int HashBlock(char *data, unsigned int size)
+{
+	unsigned int h;
+	unsigned int i;
 
-	//debug mode
-	if (debug_mode)
-		spiNN_write_memory(node_address, (char*)&debug_mode,        (unsigned int)DAMSONRT_SYSTEM_GLOBAL_ADDRESS(24), sizeof(unsigned int));		//24 = debug mode
+	h = 2166136261u;
+	for (i=0; i<size; i++)
+		h = (h ^ (unsigned char)data[i]) * 16777619u;
+	return h;
+}
 
-	//write ev size to start of EV
-	spiNN_write_memory(node_address, (char*)&evsize, ev_start, sizeof(unsigned int));
+/**
+ * Reads the shadow of the previous load and checks which chips still hold what it describes
+ */
+void ReadShadow()
+{
+	FILE *fp;
+	NodeTransfers transfers;
+	SpiNN_address address;
+	ChipShadow *shadow;
+	unsigned int *device_epochs;
+	unsigned int header[2];
+	unsigned int chip;
+	unsigned int x;
+	unsigned int y;
+	unsigned int i;
+	int ok;
 
-	//intelligently write vectors to device (i.e. only non zero parts)
-	spiNN_writenonzero_memory(node_address, (char*)gv, gv_user_start, gv_user_size_bytes);	//gv user globals only
-	spiNN_writenonzero_memory(node_address, (char*)ev, ev_start+sizeof(unsigned int), evsize*sizeof(int)); //gv offset by 4 bytes
-	spiNN_writenonzero_memory(node_address, (char*)InterruptHash, intv_start, intv_hash_size_bytes);
+	fp = fopen(LOADER_SHADOW_FILE, "rb");
+	if (fp == NULL)
+		return;
 
-	//write logs to device
-	spiNN_writenonzero_memory(node_address, (char*)logs, logs_start, logs_size_bytes);
-	spiNN_writenonzero_memory(node_address, (char*)snapshots, snapshots_start, snapshots_size_bytes);
+	//the shadow is only used for the same machine layout
+	ok = (fread(header, sizeof(unsigned int), 2, fp) == 2) && (header[0] == SHADOW_MAGIC) && (header[1] == spinnaker_chips);
+	for (chip=0; ok && (chip<spinnaker_chips); chip++)
+	{
+		shadow = &chips[chip].shadow;
+		ok = (fread(&shadow->epoch, sizeof(unsigned int), 1, fp) == 1) &&
+			 (fread(&shadow->prototype_count, sizeof(unsigned int), 1, fp) == 1) &&
+			 (shadow->prototype_count <= MAX_CHIP_PROTOTYPES);
+		for (i=0; ok && (i<shadow->prototype_count); i++)
+		{
+			ok = (fread(&shadow->prototypes[i].content_hash, sizeof(unsigned int), 1, fp) == 1) &&
+				 (fread(&shadow->prototypes[i].address, sizeof(unsigned int), 1, fp) == 1) &&
+				 (fread(&shadow->prototypes[i].size, sizeof(unsigned int), 1, fp) == 1);
+		}
+		ok = ok && (fread(&shadow->table_blocks, sizeof(unsigned int), 1, fp) == 1);
+		if (ok)
+		{
+			shadow->table_hashes = (unsigned int*)malloc((shadow->table_blocks ? shadow->table_blocks : 1)*sizeof(unsigned int));
+			ok = (fread(shadow->table_hashes, sizeof(unsigned int), shadow->table_blocks, fp) == shadow->table_blocks);
+		}
+	}
+	fclose(fp);
+	if (!ok)
+	{
+		for (chip=0; chip<spinnaker_chips; chip++)
+			chips[chip].shadow.epoch = 0;
+		return;
+	}
 
-	//free interrupt vector
-	free(InterruptHash);
+	//a chip which has been reset (or loaded by anyone else since) no longer holds the epoch of the shadow
+	device_epochs = (unsigned int*)calloc(spinnaker_chips, sizeof(unsigned int));
+	transfers.count = 0;
+	for (x=0; x<spinnaker_layout_width; x++){
+		for (y=0; y<spinnaker_layout_height; y++){
+			chip = y + (x*spinnaker_layout_width);
+			address.x = x;
+			address.y = y;
+			address.core_id = 0;
+			if (chips[chip].shadow.epoch)
+				QueueTransfer(&transfers, GetContext(address), spiNN_read_memory_async(GetContext(address), address, (char*)&device_epochs[chip], LOADER_EPOCH_ADDRESS, sizeof(unsigned int), NULL, NULL), 0, "read load epoch");
+		}
+	}
+	WaitTransfers(&transfers, 0);
+
+	//the epoch is cleared until this load completes so that an interrupted load is never trusted
+	for (x=0; x<spinnaker_layout_width; x++){
+		for (y=0; y<spinnaker_layout_height; y++){
+			chip = y + (x*spinnaker_layout_width);
+			address.x = x;
+			address.y = y;
+			address.core_id = 0;
+			chips[chip].shadow_valid = (chips[chip].shadow.epoch != 0) && (device_epochs[chip] == chips[chip].shadow.epoch);
+			if (chips[chip].shadow_valid)
+				QueueTransfer(&transfers, GetContext(address), spiNN_write_memory_async(GetContext(address), address, (char*)&no_epoch, LOADER_EPOCH_ADDRESS, sizeof(unsigned int), NULL, NULL), 0, "clear load epoch");
+		}
+	}
+	WaitTransfers(&transfers, 0);
+	free(device_epochs);
+}
 
-	//load core map to sdram if first core from the chip (i.e. core_id == 1)
-	if (node_address.core_id == 1){
-		unsigned int device_address;
-		device_address = DAMSONRT_EV_SHARED_START;
-		//write the core map
-		spiNN_write_memory(node_address, (char*)core_map, device_address, spinnaker_chips*sizeof(unsigned int));
-		device_address += spinnaker_chips*sizeof(unsigned int);
-		//write the number of routing table values
-		spiNN_write_memory(node_address, (char*)&chips[chip].rt_count, device_address, sizeof(unsigned int));
-		device_address += sizeof(unsigned int);
-		//write the routing table
-		spiNN_write_memory(node_address, (char*)&chips[chip].rt, device_address, chips[chip].rt_count*sizeof(RoutingEntry));
+/**
+ * Marks every chip with a new epoch and saves the shadow of the shared SDRAM it now holds
+ */
+void WriteShadow()
+{
+	FILE *fp;
+	NodeTransfers transfers;
+	SpiNN_address address;
+	ChipConfig *c;
+	unsigned int header[2];
+	unsigned int written;
+	unsigned int zero;
+	unsigned int chip;
+	unsigned int x;
+	unsigned int y;
+	unsigned int i;
+
+	load_epoch = ((unsigned int)time(NULL) ^ ((unsigned int)getpid() << 16)) | 1;
+	transfers.count = 0;
+	for (x=0; x<spinnaker_layout_width; x++){
+		for (y=0; y<spinnaker_layout_height; y++){
+			address.x = x;
+			address.y = y;
+			address.core_id = 0;
+			QueueTransfer(&transfers, GetContext(address), spiNN_write_memory_async(GetContext(address), address, (char*)&load_epoch, LOADER_EPOCH_ADDRESS, sizeof(unsigned int), NULL, NULL), 0, "write load epoch");
+		}
 	}
+	WaitTransfers(&transfers, 0);
 
-	//load program to non data part of DTCM (start of space reserved for stack at runtime)
-	if (spiNN_load_application_at(node_address, prototype_object_name, DAMSONRT_DTCM_PROGRAM_START) == SPINN_FAILURE)
+	fp = fopen(LOADER_SHADOW_FILE, "wb");
+	if (fp == NULL)
 	{
-		printf("Error: Damson protoype program '%s' for node %d not found! Have you linked it!\n", prototype_object_name, node);
-		exit(0);
+		printf("Warning: unable to write loader shadow file '%s' (the next load will be complete)\n", LOADER_SHADOW_FILE);
+		return;
 	}
-	#if LOADER_DEBUG == 1
-		printf("\t\t[loader_debug] Node (%u) loaded '%s' to SpiNNaker(%d,%d,%d)\n", node, prototype_object_name, node_address.x, node_address.y, node_address.core_id);
-		CheckNodeMemory(node, gv, gvusersize, ev, evsize, intv, intvsize, logs, num_logs, snapshots, num_snapshots);
-	#endif
-
+	header[0] = SHADOW_MAGIC;
+	header[1] = spinnaker_chips;
+	fwrite(header, sizeof(unsigned int), 2, fp);
+	zero = 0;
+	for (chip=0; chip<spinnaker_chips; chip++)
+	{
+		c = &chips[chip];
+		fwrite(&load_epoch, sizeof(unsigned int), 1, fp);
+		written = 0;
+		for (i=0; i<c->prototype_count; i++)
+			written += (c->prototypes[i].state == PROTOTYPE_WRITTEN);
+		fwrite(&written, sizeof(unsigned int), 1, fp);
+		for (i=0; i<c->prototype_count; i++)
+		{
+			if (c->prototypes[i].state != PROTOTYPE_WRITTEN)
+				continue;
+			fwrite(&c->prototypes[i].content_hash, sizeof(unsigned int), 1, fp);
+			fwrite(&c->prototypes[i].address, sizeof(unsigned int), 1, fp);
+			fwrite(&c->prototypes[i].size, sizeof(unsigned int), 1, fp);
+		}
+		//chips without a core 1 node have not had their tables written
+		if (c->table_hashes)
+		{
+			fwrite(&c->table_blocks, sizeof(unsigned int), 1, fp);
+			fwrite(c->table_hashes, sizeof(unsigned int), c->table_blocks, fp);
+		}
+		else
+			fwrite(&zero, sizeof(unsigned int), 1, fp);
+	}
+	fclose(fp);
 }
 
 int CheckNodeMemory(unsigned int    node,
@@ -401,6 +2020,11 @@ int CheckNodeMemory(unsigned int    node,
 	int *device_ev;
 	InterruptVector *device_intv;
 	unsigned int *device_core_map;
+	#if LOADER_MASKED_ROUTES == 1
+		unsigned int device_rt_format;
+	#else
+		ExactRoutingEntry exact;
+	#endif
 	unsigned int device_rt_count;
 	RoutingEntry device_rt[MAX_ROUTING_TABLE_ENTRIES];
 	RuntimeLogItem  *device_logs;
@@ -463,13 +2087,13 @@ int CheckNodeMemory(unsigned int    node,
 	BuildDeviceIntVector(InterruptHash, intv, intvsize);
 
 	//get vectors from device
-	spiNN_read_memory(node_address, (char*)device_gv,   gv_user_start, gv_user_size_bytes);
-	spiNN_read_memory(node_address, (char*)device_ev,   ev_start+sizeof(unsigned int), evsize*sizeof(int));
-	spiNN_read_memory(node_address, (char*)device_intv, intv_start, intv_hash_size_bytes);
+	spiNN_read_memory(GetContext(node_address), node_address, (char*)device_gv,   gv_user_start, gv_user_size_bytes);
+	spiNN_read_memory(GetContext(node_address), node_address, (char*)device_ev,   ev_start+sizeof(unsigned int), evsize*sizeof(int));
+	spiNN_read_memory(GetContext(node_address), node_address, (char*)device_intv, intv_start, intv_hash_size_bytes);
 
 	//get logs from device
-	spiNN_read_memory(node_address, (char*)device_logs, logs_start, logs_size_bytes);
-	spiNN_read_memory(node_address, (char*)device_snapshots, snapshots_start, snapshots_size_bytes);
+	spiNN_read_memory(GetContext(node_address), node_address, (char*)device_logs, logs_start, logs_size_bytes);
+	spiNN_read_memory(GetContext(node_address), node_address, (char*)device_snapshots, snapshots_start, snapshots_size_bytes);
 
 	//check gv
 	r = 1;
@@ -499,7 +2123,7 @@ int CheckNodeMemory(unsigned int    node,
 
 		//check the core map
 		device_address = DAMSONRT_EV_SHARED_START;
-		spiNN_read_memory(node_address, (char*)device_core_map, device_address, spinnaker_chips*sizeof(unsigned int));
+		spiNN_read_memory(GetContext(node_address), node_address, (char*)device_core_map, device_address, spinnaker_chips*sizeof(unsigned int));
 		for (i=0; i< spinnaker_chips; i++)
 		{
 			unsigned int cm = core_map[i];
@@ -511,13 +2135,32 @@ int CheckNodeMemory(unsigned int    node,
 
 		//check the routing table
 		device_address += spinnaker_chips*sizeof(unsigned int);
-		spiNN_read_memory(node_address, (char*)&device_rt_count, device_address, sizeof(unsigned int));
+		#if LOADER_MASKED_ROUTES == 1
+			spiNN_read_memory(GetContext(node_address), node_address, (char*)&device_rt_format, device_address, sizeof(unsigned int));
+			if (device_rt_format != DAMSONRT_ROUTING_TABLE_FORMAT){
+				printf("Node (%d) routing table format does not match! host %x != device %x\n", node, DAMSONRT_ROUTING_TABLE_FORMAT, device_rt_format);
+				r = 0;
+			}
+			device_address += sizeof(unsigned int);
+		#endif
+		spiNN_read_memory(GetContext(node_address), node_address, (char*)&device_rt_count, device_address, sizeof(unsigned int));
 		if (device_rt_count != chips[chip].rt_count){
 			printf("Node (%d) number of routing table entries does not match! host %d != device %d\n", node, chips[chip].rt_count, device_rt_count);
 			r = 0;
 		}else{
 			device_address += sizeof(unsigned int);
-			spiNN_read_memory(node_address, (char*)device_rt, device_address, device_rt_count*sizeof(RoutingEntry));
+			#if LOADER_MASKED_ROUTES == 1
+				spiNN_read_memory(GetContext(node_address), node_address, (char*)device_rt, device_address, device_rt_count*sizeof(RoutingEntry));
+			#else
+				//exact entries are expanded in place from the last (they have the mask of every exact entry)
+				spiNN_read_memory(GetContext(node_address), node_address, (char*)device_rt, device_address, device_rt_count*sizeof(ExactRoutingEntry));
+				for (i=device_rt_count; i>0; i--){
+					exact = ((ExactRoutingEntry*)device_rt)[i-1];
+					device_rt[i-1].key = exact.key;
+					device_rt[i-1].mask = ~DAMSON_PORT_MASK;
+					device_rt[i-1].route = exact.route;
+				}
+			#endif
 
 			for (i=0; i<device_rt_count; i++)
 			{
@@ -525,6 +2168,10 @@ int CheckNodeMemory(unsigned int    node,
 					printf("Node (%d) routing entry %d key missmatch! host %d != device %d\n", node, i, chips[chip].rt[i].key, device_rt[i].key);
 					r = 0;
 				}
+				if (device_rt[i].mask != chips[chip].rt[i].mask){
+					printf("Node (%d) routing entry %d mask missmatch! host %x != device %x\n", node, i, chips[chip].rt[i].mask, device_rt[i].mask);
+					r = 0;
+				}
 				if (device_rt[i].route != chips[chip].rt[i].route){
 					printf("Node (%d) routing entry %d route missmatch! host %x != device %x\n", node, i, chips[chip].rt[i].route, device_rt[i].route);
 					r = 0;
@@ -622,6 +2269,14 @@ void Start()
 	SpiNN_address node_address;
 	HardwareMapping map;
 
+	#if LOADER_DEBUG == 1
+		spiNN_transport_stats stats;
+		for (i=0; i<(int)num_boards; i++){
+			spiNN_get_transport_stats(boards[i].context, &stats);
+			printf("\t\t[loader_debug] Board %s transport rtt %uus (var %uus), window %u, pace %uus, %u sent, %u timeouts, %u retransmits, %u duplicates\n", boards[i].ip, stats.rtt_us, stats.rtt_var_us, stats.window, stats.pace_us, stats.commands_sent, stats.timeouts, stats.retransmits, stats.duplicates);
+		}
+	#endif
+
 	//iterate the core map to start cores (always start core 1 last, always start chip 0,0 last)
 	for (x=spinnaker_layout_width-1; x>=0; x--)
 		{
@@ -639,7 +2294,7 @@ void Start()
 						printf("\t\t[loader_debug] Starting Node (%d) at SpiNNaker(%d, %d, %d)\n", map.damson_node_id, node_address.x, node_address.y, node_address.core_id);
 					#endif
 
-						spiNN_start_application_at(node_address, DAMSONRT_DTCM_PROGRAM_START);
+						spiNN_start_application_at(GetContext(node_address), node_address, DAMSONRT_DTCM_PROGRAM_START);
 					}
 				}
 			}
@@ -671,8 +2326,8 @@ void Start()
 					node_address = GetSpiNNAddress(map.spinnaker_id);
 
 					//get the size of the external external vector and end address of log data items
-					spiNN_read_memory(node_address, (char*)&log_data_start, DAMSONRT_EV_START(node_address.core_id), sizeof(int));
-					spiNN_read_memory(node_address, (char*)&log_data_end, (unsigned int)DAMSONRT_SYSTEM_GLOBAL_ADDRESS(25), sizeof(int));
+					spiNN_read_memory(GetContext(node_address), node_address, (char*)&log_data_start, DAMSONRT_EV_START(node_address.core_id), sizeof(int));
+					spiNN_read_memory(GetContext(node_address), node_address, (char*)&log_data_end, (unsigned int)DAMSONRT_SYSTEM_GLOBAL_ADDRESS(25), sizeof(int));
 					//log data starts at the end of user external vector (plus one is for the ev size at the start)
 					log_data_start = (unsigned int)DAMSONRT_EV_START(node_address.core_id) + BYTES(log_data_start) + sizeof(int);
 
@@ -681,7 +2336,7 @@ void Start()
 
 					//init some memory and then get the log data
 					log_data = (unsigned int*)malloc(log_data_size_bytes);
-					spiNN_read_memory(node_address, (char*)log_data, log_data_start, log_data_size_bytes);
+					spiNN_read_memory(GetContext(node_address), node_address, (char*)log_data, log_data_start, log_data_size_bytes);
 
 
 					log_position = 0;
@@ -976,6 +2631,83 @@ SpiNN_address GetSpiNNAddress(unsigned int spinnaker_id)
 	return s;
 }
 
+spiNN_context* GetContext(SpiNN_address address)
+{
+	return boards[chip_board[address.y + (address.x*spinnaker_layout_width)]].context;
+}
+
+/**
+ * Number of hops between two chips (links are east, north east and north so a diagonal costs a single hop)
+ */
+unsigned int ChipDistance(unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1)
+{
+	int dx;
+	int dy;
+
+	ChipOffset(x0, y0, x1, y1, &dx, &dy);
+	return HexHops(dx, dy);
+}
+
+/**
+ * Shortest offset from one chip to another. On a torus every combination of wrapping in x and y is tried as the
+ * north east/south west diagonal can make the longer way round in one dimension the shorter route overall.
+ */
+void ChipOffset(unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, int *dx, int *dy)
+{
+	int wx[3];
+	int wy[3];
+	unsigned int hops;
+	unsigned int best;
+	unsigned int i;
+	unsigned int j;
+
+	*dx = (int)x1 - (int)x0;
+	*dy = (int)y1 - (int)y0;
+	if (!spinnaker_wrap)
+		return;
+
+	wx[0] = *dx;
+	wx[1] = *dx - (int)spinnaker_layout_width;
+	wx[2] = *dx + (int)spinnaker_layout_width;
+	wy[0] = *dy;
+	wy[1] = *dy - (int)spinnaker_layout_height;
+	wy[2] = *dy + (int)spinnaker_layout_height;
+
+	//ties keep the offset which does not wrap
+	best = HexHops(wx[0], wy[0]);
+	for (i=0; i<3; i++){
+		for (j=0; j<3; j++){
+			hops = HexHops(wx[i], wy[j]);
+			if (hops < best){
+				best = hops;
+				*dx = wx[i];
+				*dy = wy[j];
+			}
+		}
+	}
+}
+
+/**
+ * Hops needed for an offset between chips
+ */
+unsigned int HexHops(int dx, int dy)
+{
+	if ((dx >= 0) == (dy >= 0))
+		return (abs(dx) > abs(dy))? abs(dx) : abs(dy);
+	return abs(dx) + abs(dy);
+}
+
+/**
+ * Boot thread of a single board (all boards share the machine layout for point to point routing)
+ */
+void* BootBoard(void *board)
+{
+	Board *b = (Board*)board;
+
+	b->booted = (spiNN_init(b->context, b->ip, spinnaker_layout_width, spinnaker_layout_height) == SPINN_SUCCESS);
+	return NULL;
+}
+
 void BuildDeviceIntVector(InterruptVector *int_hash, InterruptVector *intv, unsigned int intvsize)
 {
 	unsigned int i;
@@ -1066,104 +2798,445 @@ void HandleDebugMessage(SpiNN_address address, char* message)
 
 
 /**
- * Route a source and destination damson node by creating routing table entries for the necessary chips.
- * Currently assumes no wrap around!
+ * Routes a source damson node to all of its destinations by creating routing table entries for the chips of a multicast
+ * tree. The tree grows from the source chip by joining the destination chip nearest to the tree through a shortest path
+ * from its nearest tree chip (shortest path Steiner heuristic), so destinations share links wherever their paths would
+ * overlap. Paths use the wrap around links if the machine is a torus.
  */
-void Route(unsigned int src_id, unsigned int dst_id)
+void RouteTree(unsigned int src_id, unsigned int *dst_ids, unsigned int count)
 {
-	HardwareMapping src_mapping, dst_mapping;
 	SpiNN_address src_adr, dst_adr, tmp_adr;
-	unsigned int chip_index, route;
+	SpiNN_address *chip_adr;		//chip of each destination
+	SpiNN_address *nearest;			//tree chip nearest to each destination
+	unsigned int *distance;			//hops from the tree to each destination (0 once joined)
+	unsigned int *cores;			//route bits of the destination cores on each destination chip
+	unsigned int chip_count;
+	unsigned int key;
+	unsigned int chip_index;
+	unsigned int route;
+	unsigned int links;
+	unsigned int best;
+	unsigned int d;
+	unsigned int i;
+	unsigned int j;
+
+	key = src_id << DAMSONRT_PORT_BITS;
+	src_adr = GetSpiNNAddress(GetMapping(src_id).spinnaker_id);
+
+	chip_adr = (SpiNN_address*)malloc(count*sizeof(SpiNN_address));
+	nearest = (SpiNN_address*)malloc(count*sizeof(SpiNN_address));
+	distance = (unsigned int*)malloc(count*sizeof(unsigned int));
+	cores = (unsigned int*)malloc(count*sizeof(unsigned int));
+
+	//distinct destination chips (only the source chip is in the tree to start with)
+	chip_count = 0;
+	for (i=0; i<count; i++){
+		dst_adr = GetSpiNNAddress(GetMapping(dst_ids[i]).spinnaker_id);
+		for (j=0; j<chip_count; j++){
+			if ((chip_adr[j].x == dst_adr.x) && (chip_adr[j].y == dst_adr.y))
+				break;
+		}
+		if (j == chip_count){
+			chip_adr[j] = dst_adr;
+			nearest[j] = src_adr;
+			distance[j] = ChipDistance(src_adr.x, src_adr.y, dst_adr.x, dst_adr.y);
+			cores[j] = 0;
+			chip_count++;
+		}
+		cores[j] |= (1 << (NUM_LINKS + dst_adr.core_id));
+	}
 
-	src_mapping = GetMapping(src_id);
-	dst_mapping = GetMapping(dst_id);
+	//join the nearest destination chip until every destination chip is in the tree
+	links = 0;
+	while (1){
+		best = chip_count;
+		for (i=0; i<chip_count; i++){
+			if ((distance[i] > 0) && ((best == chip_count) || (distance[i] < distance[best])))
+				best = i;
+		}
+		if (best == chip_count)
+			break;
+
+		tmp_adr = nearest[best];
+		dst_adr = chip_adr[best];
+		while ((tmp_adr.x != dst_adr.x) || (tmp_adr.y != dst_adr.y)) {
+			chip_index = tmp_adr.y + (tmp_adr.x * spinnaker_layout_width); //chip index before updating hop
+			route = RouteStep(&tmp_adr, dst_adr);
+			createRoutingEntry(chip_index, key, route);
+			links++;
+
+			//every chip of the path is a new tree chip (a tree chip on the path would have been nearer)
+			for (i=0; i<chip_count; i++){
+				d = ChipDistance(tmp_adr.x, tmp_adr.y, chip_adr[i].x, chip_adr[i].y);
+				if (d < distance[i]){
+					distance[i] = d;
+					nearest[i] = tmp_adr;
+				}
+			}
+		}
+	}
 
-	src_adr = GetSpiNNAddress(src_mapping.spinnaker_id);
-	dst_adr = GetSpiNNAddress(dst_mapping.spinnaker_id);
-	tmp_adr = src_adr;
+	//create core mappings
+	for (i=0; i<chip_count; i++)
+		createRoutingEntry(chip_adr[i].y + (chip_adr[i].x * spinnaker_layout_width), key, cores[i]);
 
 	#if LOADER_DEBUG == 1
-		printf("\t\t[loader_debug] Routing node %d (%d,%d,%d) to %d ", src_id, src_adr.x, src_adr.y, src_adr.core_id, dst_id);
+		printf("\t\t[loader_debug] Routing node %d (%d,%d,%d) to %d nodes on %d chips over %d links\n", src_id, src_adr.x, src_adr.y, src_adr.core_id, count, chip_count, links);
 	#endif
 
-	while ((tmp_adr.x != dst_adr.x) || (tmp_adr.y != dst_adr.y)) {
-		chip_index = tmp_adr.y + (tmp_adr.x * spinnaker_layout_width); //chip index before updating hop
-		route = 0;
-		#if LOADER_DEBUG == 1
-			printf(" -> chip(%d,%d)", tmp_adr.x, tmp_adr.y);
-		#endif
+	free(chip_adr);
+	free(nearest);
+	free(distance);
+	free(cores);
+}
+
+/**
+ * Moves a route one hop towards its destination chip and returns the link taken. Diagonal links are taken while the
+ * destination is north east or south west, every hop shortens the route so the path is a shortest one.
+ */
+unsigned int RouteStep(SpiNN_address *tmp_adr, SpiNN_address dst_adr)
+{
+	unsigned int route;
+	int dx;
+	int dy;
+	int x;
+	int y;
+
+	ChipOffset(tmp_adr->x, tmp_adr->y, dst_adr.x, dst_adr.y, &dx, &dy);
+	x = tmp_adr->x;
+	y = tmp_adr->y;
+
+	route = 0;
+	if ((dx > 0) && (dy > 0)) {
+		route = LINK_NORTH_EAST;
+		x += 1;
+		y += 1;
+	} else if ((dx < 0) && (dy < 0)) {
+		route = LINK_SOUTH_WEST;
+		x -= 1;
+		y -= 1;
+	}
+
+	//no diagonal link towards the north west or south east so these take east/west hops first
+	else if (dx > 0) {
+		route = LINK_EAST;
+		x += 1;
+	} else if (dx < 0) {
+		route = LINK_WEST;
+		x -= 1;
+	}
+
+	else if (dy > 0) {
+		route = LINK_NORTH;
+		y += 1;
+	} else if (dy < 0) {
+		route = LINK_SOUTH;
+		y -= 1;
+	}
+
+	//wrap around links join the edges of a torus
+	tmp_adr->x = (x + spinnaker_layout_width) % spinnaker_layout_width;
+	tmp_adr->y = (y + spinnaker_layout_height) % spinnaker_layout_height;
+
+	return route;
+}
+
+/**
+ * Adds route bits to the entry of a key (a source node id shifted by DAMSONRT_PORT_BITS) on a chip, creating it if needed.
+ * Entries are found through the key index of the chip, safe to call from several route threads.
+ */
+void createRoutingEntry(unsigned int chip_index, unsigned int key, unsigned int route){
+	unsigned int h;
+	ChipConfig *c;
+
+	c = &chips[chip_index];
+	pthread_mutex_lock(&c->rt_lock);
 
-		if ((tmp_adr.x < dst_adr.x) && (tmp_adr.y == dst_adr.y)) {
-			route = LINK_EAST;
-			tmp_adr.x += 1;
-		} else if ((tmp_adr.x > dst_adr.x) && (tmp_adr.y == dst_adr.y)) {
-			route = LINK_WEST;
-			tmp_adr.x -= 1;
+	//keep the index at most half full
+	if (c->rt_index_size < 2*(c->rt_count+1))
+		GrowRoutingIndex(c);
+
+	//see if there is an existing entry for the key (keys are node ids shifted by the port bits)
+	h = Hash(key >> DAMSONRT_PORT_BITS, c->rt_index_size);
+	while (c->rt_index[h] != 0)
+	{
+		if (c->rt[c->rt_index[h]-1].key == key){
+			c->rt[c->rt_index[h]-1].route |= route;
+			pthread_mutex_unlock(&c->rt_lock);
+			return;
 		}
+		h = (h + 1) & (c->rt_index_size - 1);
+	}
+
+	//if no existing key then create a new one (the table is minimised once every route has been added)
+	if (c->rt_count == c->rt_size){
+		c->rt_size = (c->rt_size) ? c->rt_size*2 : 64;
+		c->rt = (RoutingEntry*)realloc(c->rt, c->rt_size*sizeof(RoutingEntry));
+	}
+	c->rt[c->rt_count].key = key;
+	c->rt[c->rt_count].mask = ~DAMSON_PORT_MASK;
+	c->rt[c->rt_count].route = route;
+	c->rt_count++;
+	c->rt_index[h] = c->rt_count;
+	pthread_mutex_unlock(&c->rt_lock);
+}
+
+/**
+ * Doubles the key index of a chip and adds every entry of its table to it
+ */
+void GrowRoutingIndex(ChipConfig *c)
+{
+	unsigned int h;
+	unsigned int i;
+
+	c->rt_index_size = NextPower2(2*(c->rt_count+1));
+	if (c->rt_index_size < 256)
+		c->rt_index_size = 256;
+	free(c->rt_index);
+	c->rt_index = (unsigned int*)calloc(c->rt_index_size, sizeof(unsigned int));
+	for (i=0; i<c->rt_count; i++){
+		h = Hash(c->rt[i].key >> DAMSONRT_PORT_BITS, c->rt_index_size);
+		while (c->rt_index[h] != 0)
+			h = (h + 1) & (c->rt_index_size - 1);
+		c->rt_index[h] = i+1;
+	}
+}
+
+/**
+ * Minimises the routing table of a chip by merging entries with the same route into key/mask entries (an Espresso style
+ * expand). Each entry clears mask bits from the lowest while it matches no key routed differently through the chip, keys
+ * which never reach the chip are free to match. Entries which then match another entry of the route are dropped, as are
+ * empty routes. Every key reaching the chip is matched only by entries of its own route so the order of the table does
+ * not matter.
+ */
+void MinimiseRoutingTable(ChipConfig *c)
+{
+	RoutingEntry *keys;
+	unsigned int count;
+	unsigned int start;
+	unsigned int end;
+	unsigned int bit;
+	unsigned int mask;
+	unsigned int i;
+	unsigned int j;
+
+	if (c->rt_count == 0)
+		return;
+
+	//keys in order for the collision search and entries grouped by route
+	keys = (RoutingEntry*)malloc(c->rt_count*sizeof(RoutingEntry));
+	memcpy(keys, c->rt, c->rt_count*sizeof(RoutingEntry));
+	qsort(keys, c->rt_count, sizeof(RoutingEntry), CompareRoutingKeys);
+	qsort(c->rt, c->rt_count, sizeof(RoutingEntry), CompareRoutingRoutes);
+
+	count = 0;
+	for (start=0; start<c->rt_count; start=end){
+		for (end=start+1; (end<c->rt_count) && (c->rt[end].route == c->rt[start].route); end++);
+		if (c->rt[start].route == 0)	//nodes which are not routed anywhere
+			continue;
 
-		else if ((tmp_adr.x == dst_adr.x) && (tmp_adr.y < dst_adr.y)) {
-			route = LINK_NORTH;
-			tmp_adr.y += 1;
-		} else if ((tmp_adr.x == dst_adr.x) && (tmp_adr.y > dst_adr.y)) {
-			route = LINK_SOUTH;
-			tmp_adr.y -= 1;
+		for (i=start; i<end; i++){
+			if (c->rt[i].mask == 0xffffffff)	//matched by an earlier entry of the route
+				continue;
+			for (bit=DAMSONRT_PORT_BITS; bit<32; bit++){
+				mask = c->rt[i].mask & ~(1u << bit);
+				if (!RouteCollides(keys, c->rt_count, c->rt[i].key & mask, mask, c->rt[i].route)){
+					c->rt[i].mask = mask;
+					c->rt[i].key &= mask;
+				}
+			}
+			for (j=i+1; j<end; j++){
+				if ((c->rt[j].mask != 0xffffffff) && ((c->rt[j].key & c->rt[i].mask) == c->rt[i].key))
+					c->rt[j].mask = 0xffffffff;
+			}
+			c->rt[count++] = c->rt[i];
 		}
+	}
+	c->rt_count = count;
+	free(keys);
+}
+
+/**
+ * Puts the routing table of a chip in key order without its empty routes (the table written when entries are not
+ * minimised, the order does not depend on the order the routes were added in)
+ */
+void ExactRoutingTable(ChipConfig *c)
+{
+	unsigned int count;
+	unsigned int i;
+
+	count = 0;
+	for (i=0; i<c->rt_count; i++){
+		if (c->rt[i].route != 0)
+			c->rt[count++] = c->rt[i];
+	}
+	c->rt_count = count;
+	qsort(c->rt, c->rt_count, sizeof(RoutingEntry), CompareRoutingKeys);
+}
 
-		else if ((tmp_adr.x < dst_adr.x) && (tmp_adr.y < dst_adr.y)) {
-			route = LINK_NORTH_EAST;
-			tmp_adr.x += 1;
-			tmp_adr.y += 1;
-		} else if ((tmp_adr.x > dst_adr.x) && (tmp_adr.y > dst_adr.y)) {
-			route = LINK_SOUTH_WEST;
-			tmp_adr.x -= 1;
-			tmp_adr.y -= 1;
+/**
+ * Returns 1 if a key/mask would match a key (in order) with a different route
+ */
+int RouteCollides(RoutingEntry *keys, unsigned int count, unsigned int key, unsigned int mask, unsigned int route)
+{
+	unsigned int i;
+	unsigned int k;
+	unsigned int bit;
+	unsigned int low_bits;
+	unsigned int next;
+
+	//matched keys lie between the key and the key with every masked out bit set
+	i = FindRoutingKey(keys, 0, count, key);
+	while ((i < count) && (keys[i].key <= (key | ~mask))){
+		k = keys[i].key;
+		if ((k & mask) == key){
+			if (keys[i].route != route)
+				return 1;
+			i++;
+			continue;
 		}
 
-		//special cases where there is no direct mapping
-		else if ((tmp_adr.x < dst_adr.x) && (tmp_adr.y > dst_adr.y)) {
-			route = LINK_EAST;
-			tmp_adr.x += 1;
-		} else if ((tmp_adr.x > dst_adr.x) && (tmp_adr.y < dst_adr.y)) {
-			route = LINK_WEST;
-			tmp_adr.x -= 1;
+		//skip to the next key which can match, from the highest masked bit which differs
+		for (bit=31; !(((k ^ key) & mask) & (1u << bit)); bit--);
+		low_bits = (bit == 31) ? 0xffffffff : ((2u << bit) - 1);
+		if (key & (1u << bit)){
+			next = (k & ~low_bits) | (key & low_bits);
+		}else{
+			next = (k | mask | low_bits) + 1;	//carry into the lowest masked out bit above
+			if (next == 0)
+				return 0;
+			next = (next & ~mask & ~low_bits) | key;
 		}
+		i = FindRoutingKey(keys, i+1, count, next);
+	}
+	return 0;
+}
 
-		createRoutingEntry(chip_index, src_id<< DAMSONRT_PORT_BITS, route);
+/**
+ * First of the keys (in order) from low which is not less than a key
+ */
+unsigned int FindRoutingKey(RoutingEntry *keys, unsigned int low, unsigned int count, unsigned int key)
+{
+	unsigned int high;
+	unsigned int mid;
+
+	high = count;
+	while (low < high){
+		mid = (low + high) / 2;
+		if (keys[mid].key < key)
+			low = mid + 1;
+		else
+			high = mid;
 	}
+	return low;
+}
 
-	#if LOADER_DEBUG == 1
-		printf(" -> cpu(%d)\n", dst_adr.core_id);
-	#endif
+int CompareRoutingKeys(const void *a, const void *b)
+{
+	const RoutingEntry *ea = (const RoutingEntry*)a;
+	const RoutingEntry *eb = (const RoutingEntry*)b;
+
+	if (ea->key != eb->key)
+		return (ea->key < eb->key) ? -1 : 1;
+	return 0;
+}
+
+int CompareRoutingRoutes(const void *a, const void *b)
+{
+	const RoutingEntry *ea = (const RoutingEntry*)a;
+	const RoutingEntry *eb = (const RoutingEntry*)b;
+
+	if (ea->route != eb->route)
+		return (ea->route < eb->route) ? -1 : 1;
+	return CompareRoutingKeys(a, b);
+}
+
+/**
+ * Exits if a transfer to a node failed (the transport has already retried idempotent commands)
+ */
+void CheckTransfer(int result, unsigned int node, char* description)
+{
+	if (result == SPINN_FAILURE)
+	{
+		printf("Error: failed to %s for node %d\n", description, node);
+		exit(0);
+	}
+}
+
+/**
+ * Adds a submitted transfer to the transfers of the node being loaded (waits for the node transfers if there are too many)
+ */
+void QueueTransfer(NodeTransfers *transfers, spiNN_context *context, spiNN_request request, unsigned int node, char* description)
+{
+	CheckTransfer(request != 0, node, description);
 
-	chip_index = dst_adr.y + (dst_adr.x * spinnaker_layout_width);
-	route = (1 << (NUM_LINKS + dst_adr.core_id));
-	//create core mapping
-	createRoutingEntry(chip_index, src_id<< DAMSONRT_PORT_BITS, route);
+	if (transfers->count == MAX_NODE_TRANSFERS)
+		WaitTransfers(transfers, node);
+
+	transfers->contexts[transfers->count] = context;
+	transfers->requests[transfers->count] = request;
+	transfers->descriptions[transfers->count] = description;
+	transfers->count++;
 }
 
-void createRoutingEntry(unsigned int chip_index, unsigned int src_id, unsigned int route){
+/**
+ * Waits for every queued transfer of the node being loaded (exits if any failed)
+ */
+void WaitTransfers(NodeTransfers *transfers, unsigned int node)
+{
 	unsigned int i;
-	ChipConfig *c;
 
-	c = &chips[chip_index];
+	for (i=0; i<transfers->count; i++)
+		CheckTransfer(spiNN_wait(transfers->contexts[i], transfers->requests[i]), node, transfers->descriptions[i]);
+	transfers->count = 0;
+}
+
+/**
+ * Load worker thread (loads queued nodes until FinishLoading() is called and the queue is empty)
+ */
+void* LoadWorker(void *arg)
+{
+	LoadJob job;
+	NodeTransfers transfers;
 
-	//see if there is an existing entry for the key
-	for (i=0; i < c->rt_count; i++)
+	(void)arg;	//workers share the load queue
+	transfers.count = 0;
+	while (1)
 	{
-		if (c->rt[i].key == src_id){
-			c->rt[i].route |= route;
-			return;
+		pthread_mutex_lock(&load_queue_lock);
+		while ((load_queue_count == 0) && (!loading_finished))
+			pthread_cond_wait(&load_queue_not_empty, &load_queue_lock);
+		if (load_queue_count == 0)
+		{
+			pthread_mutex_unlock(&load_queue_lock);
+			return NULL;
 		}
+		job = load_queue[load_queue_head];
+		load_queue_head = (load_queue_head + 1) % LOAD_QUEUE_SIZE;
+		load_queue_count--;
+		pthread_cond_signal(&load_queue_not_full);
+		pthread_mutex_unlock(&load_queue_lock);
+
+		LoadQueuedNode(&job, &transfers);
+
+		free(job.gv);
+		free(job.ev);
+		free(job.intv);
+		free(job.logs);
+		free(job.snapshots);
 	}
+}
 
-	//if no existing key then create a new one
-	if (c->rt_count >= MAX_ROUTING_TABLE_ENTRIES){
-		printf("Error: Chip %d routing table overflow\n", chip_index);
-		exit(0);
-	}
-	c->rt[c->rt_count].key = src_id ;
-	c->rt[c->rt_count].route = route;
-	c->rt_count++;
+/**
+ * Copies a vector of a queued node
+ */
+void* CopyVector(void *vector, unsigned int size)
+{
+	void *copy;
+
+	copy = malloc(size ? size : 1);
+	memcpy(copy, vector, size);
+	return copy;
 }
 
 /* From DAMSON emulator */
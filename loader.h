@@ -1,11 +1,36 @@
 #ifndef LOADER
 #define LOADER
 
+#ifndef LOADER_DEBUG
 #define LOADER_DEBUG 		1
+#endif
+#define LOADER_WARM_ATTACH	1		//attach to boards which already run SCAMP instead of booting them again
+#define LOADER_READY_TIMEOUT 5000	//time allowed for every chip to answer once the boards are up (ms)
+#define LOADER_PLACEMENT	1		//place nodes by partitioning the interrupt graph over the chips (0 places nodes in list order)
+#ifndef LOADER_MASKED_ROUTES
+#define LOADER_MASKED_ROUTES	0		//minimise routing tables into masked entries (needs a runtime which reads the masked layout, 0 writes exact entries)
+#endif
+#define LOADER_ROUTE_THREADS	8		//threads building the routing tables (sources are routed and chips minimised concurrently)
+#define LOADER_WORKERS		8		//nodes loaded at once (threads sharing the board connections, each holds at most 5 requests)
 #define MAX_STRING_SIZE 	128
+#define LOADER_STAGING_SIZE	(256*1024)	//bytes of shared SDRAM used by each core to stage compressed uploads (top of the loader reserved area)
+#define LOADER_SHARED_PROTOTYPES 1	//write each prototype once per chip to shared SDRAM and copy it to every core which runs it
+#define LOADER_PROTOTYPE_AREA_SIZE (512*1024)	//bytes of shared SDRAM holding the prototypes of a chip (below the staging areas)
+#define LOADER_PROTOTYPE_START	(LOADER_STAGING_START(1)-LOADER_PROTOTYPE_AREA_SIZE)
+#define LOADER_VERIFY		1		//verify every node once loaded by reading its memory back (a node which differs fails the load, always on in debug builds)
+#define LOADER_INCREMENTAL	1		//skip shared SDRAM writes which match the shadow of the previous load
+#define LOADER_SHADOW_FILE	"loader.shadow"	//host shadow of the shared SDRAM written by the previous load
+#define LOADER_SHADOW_BLOCK	256		//bytes of the core map and routing table covered by each hash of the shadow
+#define LOADER_EPOCH_ADDRESS	(LOADER_PROTOTYPE_START-sizeof(unsigned int))	//shared SDRAM word holding the epoch of the last complete load
+#define LOADER_STAGING_START(n)	(DAMSONRT_EV_SHARED_START+DAMSONRT_EV_SHARED_SIZE-((17-(n))*LOADER_STAGING_SIZE))	//staging area of core 0<n<=16
 
 #include "damson_runtime.h"
 
+//the staging areas, prototypes and epoch word must fit in the shared SDRAM which the runtime leaves to the loader
+#if (16*LOADER_STAGING_SIZE + LOADER_PROTOTYPE_AREA_SIZE + 4) > DAMSONRT_LOADER_RESERVED_SIZE
+#error "loader staging and prototype areas do not fit in DAMSONRT_LOADER_RESERVED_SIZE"
+#endif
+
 // interrupt vector
 typedef struct
 {
@@ -73,6 +98,7 @@ void MapNodes();
 /**
  * Initialises a SpiNNaker core and loads the prototype program into instruction memory
  * Intelligently load the gv, ev and interrupt vector
+ * The node is queued for a load worker (the vectors are copied) so it may not be loaded until FinishLoading() returns
  */
 void LoadNode(unsigned int    node,
 			  char            *prototype_object_name,
@@ -83,6 +109,16 @@ void LoadNode(unsigned int    node,
 			  RuntimeLogItem  *snapshots,unsigned int num_snapshots,
 			  int debug_mode);
 
+/**
+ * Maps a prototype program into the host file cache (exits if the prototype can not be found)
+ */
+void CachePrototype(unsigned int node, char *prototype_object_name);
+
+/**
+ * Waits until every node queued by LoadNode() has been loaded
+ */
+void FinishLoading();
+
 /**
  * Checks that the node info has been loaded to the appropriate area of memory on the SpiNNaker core. If any errors are found 0 is returned.
  */
@@ -98,8 +98,9 @@ int main(int argc, char *argv[])
 		{
 			break;
 		}
-		//skip node alias data
-		skipstring(FileStream);
+		//prototype name (mapped now so that a missing prototype is reported before loading starts)
+		getstring(prototype_name, MAX_STRING_SIZE, FileStream);
+		CachePrototype(node_map.damson_node_id, prototype_name);
 		gv_size = getword(FileStream);
 		gv_size++;	//first gv value is 0
 		for (i=0; i<gv_size; i++)
@@ -262,6 +263,7 @@ int main(int argc, char *argv[])
 		LoadNode(n, prototype_name, gv, gv_size, ev, ev_size, iv, interrupts, logs, num_logs, snapshots, num_snapshots, debug_mode);
 
     }
+    FinishLoading();
     gettimeofday(&tv, NULL);
     t2 = tv.tv_sec * 1000 + tv.tv_usec/1000;
 
@@ -0,0 +1,467 @@
+/*
+ * Routing checks which run without a machine (make -f loader.make routing_test). Routes a random interrupt graph over a
+ * torus and over a machine without wrap around links, then follows the packets of every source through the routing
+ * tables. The multicast tree of a source must reach exactly its destination cores, never enter a chip twice and use no
+ * more links than a separate shortest path to each destination chip. The tables built by BuildRoutingTables() (on
+ * LOADER_ROUTE_THREADS threads) must equal the tables routed and minimised on one thread, every key must be routed by the
+ * minimised tables as by the exact tables and RouteCollides() must agree with a search of every key. Tables are only
+ * minimised if the check is built with LOADER_MASKED_ROUTES (TEST_FLAGS=-DLOADER_MASKED_ROUTES=1). Returns 1 if any
+ * check fails.
+ */
+#include "loader.c"
+
+#include <time.h>
+
+#define TEST_SEED			9
+#define TEST_LOCALITY		400		//destinations of a node are within TEST_LOCALITY/2 node ids of it
+
+typedef struct {
+	char *name;
+	unsigned int width;
+	unsigned int height;
+	int wrap;
+	unsigned int nodes;
+	unsigned int fanout;				//interrupts of each node
+} TestMachine;
+
+TestMachine test_machines[] = {{"torus", 16, 16, 1, 4000, 30}, {"mesh", 8, 8, 0, 900, 12}};
+
+unsigned int *test_dst_start;			//first destination of each source in test_dsts
+unsigned int *test_dsts;				//destinations grouped by source
+RoutingEntry **test_exact;				//tables of each chip as routed (in key order)
+unsigned int *test_exact_count;
+RoutingEntry **test_minimised;			//exact tables minimised on one thread
+unsigned int *test_minimised_count;
+
+int link_dx[NUM_LINKS] = {1, 1, 0, -1, -1, 0};	//east, north east, north, west, south west, south
+int link_dy[NUM_LINKS] = {0, 1, 1, 0, -1, -1};
+
+void SetupMachine(TestMachine *m);
+void RouteExact();
+void MinimiseExact();
+unsigned int ExactRoute(unsigned int chip, unsigned int key);
+unsigned int MinimisedRoute(unsigned int chip, unsigned int key, unsigned int *errors);
+unsigned int CheckSource(unsigned int src, int minimised, unsigned int *links, unsigned int *path_hops);
+unsigned int CheckBuild();
+unsigned int CheckCollisions();
+void FreeMachine();
+
+int main()
+{
+	TestMachine *m;
+	unsigned int t;
+	unsigned int src;
+	unsigned int errors;
+	unsigned int links;
+	unsigned int path_hops;
+	unsigned int exact_entries;
+	unsigned int entries;
+	unsigned int i;
+	int overflow;
+	struct timespec t1, t2;
+	int failed;
+
+	failed = 0;
+	for (t=0; t<sizeof(test_machines)/sizeof(TestMachine); t++){
+		m = &test_machines[t];
+		SetupMachine(m);
+		RouteExact();
+
+		errors = 0;
+		links = 0;
+		path_hops = 0;
+		for (src=1; src<=m->nodes; src++)
+			errors += CheckSource(src, 0, &links, &path_hops);
+		printf("%s %ux%u: %u nodes, %u interrupts, %u tree links (%u hops as separate paths), %u errors\n", m->name, m->width, m->height, m->nodes, m->nodes*m->fanout, links, path_hops, errors);
+		if (errors > 0)
+			failed = 1;
+
+		//the threaded build starts from empty tables
+		MinimiseExact();
+		for (i=0; i<spinnaker_chips; i++){
+			free(chips[i].rt_index);
+			chips[i].rt_index = NULL;
+			chips[i].rt_index_size = 0;
+			chips[i].rt_count = 0;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		overflow = BuildRoutingTables();
+		clock_gettime(CLOCK_MONOTONIC, &t2);
+
+		exact_entries = 0;
+		entries = 0;
+		for (i=0; i<spinnaker_chips; i++){
+			exact_entries += test_exact_count[i];
+			entries += chips[i].rt_count;
+		}
+		errors = CheckBuild() + CheckCollisions();
+		links = 0;
+		path_hops = 0;
+		for (src=1; src<=m->nodes; src++)
+			errors += CheckSource(src, 1, &links, &path_hops);
+		printf("%s %ux%u: %u entries built as %u in %ld ms on %d threads (overflow %d), %u errors\n", m->name, m->width, m->height, exact_entries, entries, (long)((t2.tv_sec - t1.tv_sec)*1000 + (t2.tv_nsec - t1.tv_nsec)/1000000), LOADER_ROUTE_THREADS, overflow, errors);
+		if (errors > 0)
+			failed = 1;
+		FreeMachine();
+	}
+
+	return failed;
+}
+
+/**
+ * Creates the nodes of a random interrupt graph, places them in list order and lists the destinations of each source
+ */
+void SetupMachine(TestMachine *m)
+{
+	NodeMapItem item;
+	NodeMapItemList *n;
+	unsigned int *chip_of;
+	unsigned int i;
+	unsigned int k;
+	int d;
+
+	spinnaker_layout_width = m->width;
+	spinnaker_layout_height = m->height;
+	spinnaker_chips = m->width*m->height;
+	spinnaker_wrap = m->wrap;
+	chips = (ChipConfig*)calloc(spinnaker_chips, sizeof(ChipConfig));
+	for (i=0; i<spinnaker_chips; i++)
+		pthread_mutex_init(&chips[i].rt_lock, NULL);
+	core_map = (unsigned int*)calloc(spinnaker_chips, sizeof(unsigned int));
+
+	//nodes interrupt nodes with nearby ids (the list is in id order once every node is added)
+	srand(TEST_SEED);
+	for (i=m->nodes; i>=1; i--){
+		memset(&item, 0, sizeof(NodeMapItem));
+		item.damson_node_id = i;
+		item.num_interrupts = m->fanout;
+		item.interrupts = (unsigned int*)malloc(m->fanout*sizeof(unsigned int));
+		for (k=0; k<m->fanout; k++){
+			d = (int)i + (rand() % TEST_LOCALITY) - TEST_LOCALITY/2;
+			if (d < 1)
+				d += m->nodes;
+			if (d > (int)m->nodes)
+				d -= m->nodes;
+			item.interrupts[k] = d;
+		}
+		AddNodeMapItem(&item);
+	}
+
+	MappingHashSize = 2*m->nodes;
+	MappingHash = (HardwareMapping*)calloc(MappingHashSize, sizeof(HardwareMapping));
+	ReverseMappingHash = (HardwareMapping*)calloc(MappingHashSize, sizeof(HardwareMapping));
+	chip_of = (unsigned int*)malloc(node_count*sizeof(unsigned int));
+	PlaceNodesLinear(chip_of);
+	AssignCores(chip_of);
+	free(chip_of);
+
+	//destinations of each source (interrupts of a node are the sources which interrupt it)
+	test_dst_start = (unsigned int*)calloc(m->nodes+2, sizeof(unsigned int));
+	test_dsts = (unsigned int*)malloc(m->nodes*m->fanout*sizeof(unsigned int));
+	for (n = node_map_start; n != NULL; n = n->next){
+		for (k=0; k<n->node_map_item.num_interrupts; k++)
+			test_dst_start[n->node_map_item.interrupts[k]+1]++;
+	}
+	for (i=1; i<=m->nodes+1; i++)
+		test_dst_start[i] += test_dst_start[i-1];
+	for (n = node_map_start; n != NULL; n = n->next){
+		for (k=0; k<n->node_map_item.num_interrupts; k++)
+			test_dsts[test_dst_start[n->node_map_item.interrupts[k]]++] = n->node_map_item.damson_node_id;
+	}
+	for (i=m->nodes+1; i>0; i--)
+		test_dst_start[i] = test_dst_start[i-1];
+	test_dst_start[0] = 0;
+}
+
+/**
+ * Routes every source in turn (as BuildRoutingTables() does before minimising) and keeps the tables in key order
+ */
+void RouteExact()
+{
+	NodeMapItemList *n;
+	SpiNN_address adr;
+	unsigned int i;
+	unsigned int src;
+
+	for (n = node_map_start; n != NULL; n = n->next){
+		adr = GetSpiNNAddress(GetMapping(n->node_map_item.damson_node_id).spinnaker_id);
+		createRoutingEntry(adr.y + (adr.x * spinnaker_layout_width), n->node_map_item.damson_node_id << DAMSONRT_PORT_BITS, 0);
+	}
+	for (src=1; src<=node_count; src++){
+		if (test_dst_start[src+1] > test_dst_start[src])
+			RouteTree(src, &test_dsts[test_dst_start[src]], test_dst_start[src+1] - test_dst_start[src]);
+	}
+
+	test_exact = (RoutingEntry**)malloc(spinnaker_chips*sizeof(RoutingEntry*));
+	test_exact_count = (unsigned int*)malloc(spinnaker_chips*sizeof(unsigned int));
+	for (i=0; i<spinnaker_chips; i++){
+		test_exact[i] = (RoutingEntry*)malloc((chips[i].rt_count+1)*sizeof(RoutingEntry));
+		memcpy(test_exact[i], chips[i].rt, chips[i].rt_count*sizeof(RoutingEntry));
+		qsort(test_exact[i], chips[i].rt_count, sizeof(RoutingEntry), CompareRoutingKeys);
+		test_exact_count[i] = chips[i].rt_count;
+	}
+}
+
+/**
+ * Minimises (or orders, without LOADER_MASKED_ROUTES) a copy of every exact table on one thread
+ */
+void MinimiseExact()
+{
+	ChipConfig c;
+	unsigned int i;
+
+	test_minimised = (RoutingEntry**)malloc(spinnaker_chips*sizeof(RoutingEntry*));
+	test_minimised_count = (unsigned int*)malloc(spinnaker_chips*sizeof(unsigned int));
+	for (i=0; i<spinnaker_chips; i++){
+		memset(&c, 0, sizeof(ChipConfig));
+		c.rt = (RoutingEntry*)malloc((test_exact_count[i]+1)*sizeof(RoutingEntry));
+		memcpy(c.rt, test_exact[i], test_exact_count[i]*sizeof(RoutingEntry));
+		c.rt_count = test_exact_count[i];
+		c.rt_size = test_exact_count[i]+1;
+		#if LOADER_MASKED_ROUTES == 1
+			MinimiseRoutingTable(&c);
+		#else
+			ExactRoutingTable(&c);
+		#endif
+		test_minimised[i] = c.rt;
+		test_minimised_count[i] = c.rt_count;
+	}
+}
+
+/**
+ * Route of a packet key through a chip as routed (0 if the chip has no entry for it)
+ */
+unsigned int ExactRoute(unsigned int chip, unsigned int key)
+{
+	unsigned int i;
+
+	key &= ~DAMSON_PORT_MASK;
+	i = FindRoutingKey(test_exact[chip], 0, test_exact_count[chip], key);
+	if ((i < test_exact_count[chip]) && (test_exact[chip][i].key == key))
+		return test_exact[chip][i].route;
+	return 0;
+}
+
+/**
+ * Route of a packet key through a chip by the built tables (0 if no entry matches it), entries which match must agree
+ */
+unsigned int MinimisedRoute(unsigned int chip, unsigned int key, unsigned int *errors)
+{
+	ChipConfig *c;
+	unsigned int route;
+	unsigned int matches;
+	unsigned int i;
+
+	c = &chips[chip];
+	route = 0;
+	matches = 0;
+	for (i=0; i<c->rt_count; i++){
+		if ((key & c->rt[i].mask) != c->rt[i].key)
+			continue;
+		if ((matches > 0) && (c->rt[i].route != route)){
+			printf("Key %x matches entries with routes %x and %x on chip %u\n", key, route, c->rt[i].route, chip);
+			(*errors)++;
+		}
+		route = c->rt[i].route;
+		matches++;
+	}
+	return route;
+}
+
+/**
+ * Follows a packet of a source from its chip through the exact (or built) routing tables and returns the number of
+ * errors found
+ */
+unsigned int CheckSource(unsigned int src, int minimised, unsigned int *links, unsigned int *path_hops)
+{
+	SpiNN_address src_adr;
+	SpiNN_address dst_adr;
+	unsigned int *queue;
+	unsigned int *delivered;			//cores reached on each chip
+	unsigned int *expected;				//destination cores on each chip
+	char *seen;
+	unsigned int head;
+	unsigned int tail;
+	unsigned int key;
+	unsigned int chip;
+	unsigned int route;
+	unsigned int tree_links;
+	unsigned int hops;
+	unsigned int errors;
+	unsigned int i;
+	int x;
+	int y;
+
+	queue = (unsigned int*)malloc(spinnaker_chips*sizeof(unsigned int));
+	delivered = (unsigned int*)calloc(spinnaker_chips, sizeof(unsigned int));
+	expected = (unsigned int*)calloc(spinnaker_chips, sizeof(unsigned int));
+	seen = (char*)calloc(spinnaker_chips, sizeof(char));
+	errors = 0;
+	tree_links = 0;
+	hops = 0;
+
+	src_adr = GetSpiNNAddress(GetMapping(src).spinnaker_id);
+	for (i=test_dst_start[src]; i<test_dst_start[src+1]; i++){
+		dst_adr = GetSpiNNAddress(GetMapping(test_dsts[i]).spinnaker_id);
+		chip = dst_adr.y + (dst_adr.x * spinnaker_layout_width);
+		if (expected[chip] == 0)
+			hops += ChipDistance(src_adr.x, src_adr.y, dst_adr.x, dst_adr.y);
+		expected[chip] |= 1 << dst_adr.core_id;
+	}
+
+	//any port of the source is routed the same way
+	key = (src << DAMSONRT_PORT_BITS) | (rand() & DAMSON_PORT_MASK);
+	head = 0;
+	tail = 0;
+	queue[tail++] = src_adr.y + (src_adr.x * spinnaker_layout_width);
+	seen[queue[0]] = 1;
+	while (head < tail){
+		chip = queue[head++];
+		route = ExactRoute(chip, key);
+		if (minimised && (MinimisedRoute(chip, key, &errors) != route)){
+			printf("Source %u is routed %x by the minimised table of chip %u instead of %x\n", src, MinimisedRoute(chip, key, &errors), chip, route);
+			errors++;
+		}
+		delivered[chip] = route >> NUM_LINKS;
+		for (i=0; i<NUM_LINKS; i++){
+			if (!(route & (1 << i)))
+				continue;
+			tree_links++;
+			x = (int)(chip / spinnaker_layout_width) + link_dx[i];
+			y = (int)(chip % spinnaker_layout_width) + link_dy[i];
+			if (spinnaker_wrap){
+				x = (x + spinnaker_layout_width) % spinnaker_layout_width;
+				y = (y + spinnaker_layout_height) % spinnaker_layout_height;
+			}else if ((x < 0) || (y < 0) || (x >= (int)spinnaker_layout_width) || (y >= (int)spinnaker_layout_height)){
+				printf("Source %u is routed off the edge of chip %u\n", src, chip);
+				errors++;
+				continue;
+			}
+			if (seen[y + x*spinnaker_layout_width]){
+				printf("Source %u enters chip %u twice\n", src, y + x*spinnaker_layout_width);
+				errors++;
+				continue;
+			}
+			seen[y + x*spinnaker_layout_width] = 1;
+			queue[tail++] = y + x*spinnaker_layout_width;
+		}
+	}
+
+	if (tree_links > hops){
+		printf("Source %u uses %u links where separate paths would use %u\n", src, tree_links, hops);
+		errors++;
+	}
+	*links += tree_links;
+	*path_hops += hops;
+	for (chip=0; chip<spinnaker_chips; chip++){
+		if (delivered[chip] != expected[chip]){
+			printf("Source %u reaches cores %x of chip %u instead of %x\n", src, delivered[chip], chip, expected[chip]);
+			errors++;
+		}
+	}
+
+	free(queue);
+	free(delivered);
+	free(expected);
+	free(seen);
+	return errors;
+}
+
+/**
+ * Compares the tables built by BuildRoutingTables() with the tables minimised on one thread and routes every key of the
+ * exact tables through the built tables
+ */
+unsigned int CheckBuild()
+{
+	unsigned int errors;
+	unsigned int key;
+	unsigned int i;
+	unsigned int j;
+
+	errors = 0;
+	for (i=0; i<spinnaker_chips; i++){
+		if ((chips[i].rt_count != test_minimised_count[i]) || (memcmp(chips[i].rt, test_minimised[i], chips[i].rt_count*sizeof(RoutingEntry)) != 0)){
+			printf("Chip %u table differs from the single threaded build (%u != %u entries)\n", i, chips[i].rt_count, test_minimised_count[i]);
+			errors++;
+		}
+		for (j=0; j<test_exact_count[i]; j++){
+			key = test_exact[i][j].key | (rand() & DAMSON_PORT_MASK);
+			if (MinimisedRoute(i, key, &errors) != test_exact[i][j].route){
+				printf("Key %x is routed %x by the minimised table of chip %u instead of %x\n", key, MinimisedRoute(i, key, &errors), i, test_exact[i][j].route);
+				errors++;
+			}
+		}
+	}
+	return errors;
+}
+
+/**
+ * Compares RouteCollides() with a search of every key for masks one bit wider than entries of the built tables
+ */
+unsigned int CheckCollisions()
+{
+	RoutingEntry *e;
+	unsigned int errors;
+	unsigned int mask;
+	unsigned int key;
+	unsigned int bit;
+	int collides;
+	unsigned int i;
+	unsigned int j;
+	unsigned int k;
+
+	errors = 0;
+	for (i=0; i<spinnaker_chips; i++){
+		for (j=0; j<chips[i].rt_count; j+=8){
+			e = &chips[i].rt[j];
+			for (bit=DAMSONRT_PORT_BITS; bit<32; bit++){
+				mask = e->mask & ~(1u << bit);
+				key = e->key & mask;
+				collides = 0;
+				for (k=0; k<test_exact_count[i]; k++){
+					if (((test_exact[i][k].key & mask) == key) && (test_exact[i][k].route != e->route))
+						collides = 1;
+				}
+				if (RouteCollides(test_exact[i], test_exact_count[i], key, mask, e->route) != collides){
+					printf("RouteCollides(%x, %x) on chip %u returns %d instead of %d\n", key, mask, i, !collides, collides);
+					errors++;
+				}
+			}
+		}
+	}
+	return errors;
+}
+
+/**
+ * Frees the machine and graph of a test
+ */
+void FreeMachine()
+{
+	NodeMapItemList *n;
+	unsigned int i;
+
+	for (i=0; i<spinnaker_chips; i++){
+		free(chips[i].rt);
+		free(chips[i].rt_index);
+		free(test_exact[i]);
+		free(test_minimised[i]);
+		pthread_mutex_destroy(&chips[i].rt_lock);
+	}
+	free(chips);
+	free(core_map);
+	free(test_exact);
+	free(test_exact_count);
+	free(test_minimised);
+	free(test_minimised_count);
+	free(MappingHash);
+	free(ReverseMappingHash);
+	free(test_dst_start);
+	free(test_dsts);
+	while (node_map_start != NULL){
+		n = node_map_start;
+		node_map_start = n->next;
+		free(n->node_map_item.interrupts);
+		free(n);
+	}
+	node_count = 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * Sparse write checks which run without a machine (make -f loader.make runtime_test). Plans the chunks of a sparse write
+ * (as spiNN_writenonzero_memory() issues them) for every pattern of zero and non zero bytes of short buffers at every
+ * alignment and applies them to a zeroed copy of device memory. Every chunk must make progress and the device copy must
+ * equal the buffer once the write completes. Returns 1 if any check fails.
+ */
+#include "spiNN_runtime.c"
+
+#define TEST_MAX_LENGTH		12		//buffers of up to TEST_MAX_LENGTH bytes (every zero pattern)
+
+unsigned int CheckSparseWrite(char* data, unsigned int size, unsigned int device_address);
+
+int main()
+{
+	char data[TEST_MAX_LENGTH];
+	char tail[7] = {1, 2, 3, 4, 0, 0, 5};	//odd length with a tail word led by a zero byte
+	unsigned int errors;
+	unsigned int cases;
+	unsigned int size;
+	unsigned int pattern;
+	unsigned int address;
+	unsigned int i;
+
+	errors = CheckSparseWrite(tail, sizeof(tail), 0x60000000);
+	cases = 1;
+	for (size=1; size<=TEST_MAX_LENGTH; size++){
+		for (pattern=0; pattern < (1u << size); pattern++){
+			for (i=0; i<size; i++)
+				data[i] = (pattern & (1u << i)) ? (char)(i+1) : 0;
+			for (address=0x60000000; address<0x60000004; address++){
+				errors += CheckSparseWrite(data, size, address);
+				cases++;
+			}
+		}
+	}
+
+	printf("sparse writes: %u cases, %u errors\n", cases, errors);
+	return (errors > 0);
+}
+
+/**
+ * Applies the chunks of a sparse write to a zeroed copy of device memory and returns the number of errors found
+ */
+unsigned int CheckSparseWrite(char* data, unsigned int size, unsigned int device_address)
+{
+	async_request r;
+	char device[TEST_MAX_LENGTH];
+	unsigned int chunks;
+	unsigned int len;
+
+	memset(&r, 0, sizeof(async_request));
+	r.type = REQUEST_WRITE_NONZERO;
+	r.host = data;
+	r.device_address = device_address;
+	r.size = size;
+	r.completion.status = SPINN_REQUEST_PENDING;
+	memset(device, 0, sizeof(device));
+
+	//every chunk writes at least one byte so a write never needs more chunks than bytes
+	for (chunks=0; next_chunk(&r); chunks++){
+		len = chunk_length(&r);
+		if ((len == 0) || (len > r.size - r.offset) || (chunks == size)){
+			printf("Sparse write of %u bytes at %x makes no progress at offset %u\n", size, device_address, r.offset);
+			return 1;
+		}
+		memcpy(&device[r.offset], &data[r.offset], len);
+		r.offset += len;
+	}
+
+	if (memcmp(device, data, size) != 0){
+		printf("Sparse write of %u bytes at %x does not write every non zero byte\n", size, device_address);
+		return 1;
+	}
+	return 0;
+}
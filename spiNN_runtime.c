@@ -7,14 +7,19 @@
  *     Jim Garside - initial design documentation
  ******************************************************************************************/
 
+#define _GNU_SOURCE		//sendmmsg/recvmmsg
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <assert.h>
 #include <sys/time.h>
 #include <limits.h>
 #include <time.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
 #include <arpa/inet.h>
 #include <sys/un.h>
 #include <netinet/in.h>
@@ -22,6 +27,14 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 
 #include "spiNN_runtime.h"
@@ -38,8 +51,33 @@
 #define SDP_DATA_MAX 256
 
 #define SPINNAKER_CMD_DELAY 10000
+#define SPINNAKER_CMD_WINDOW 16		//maximum number of commands in flight (power of 2)
+#define SPINNAKER_CMD_RETRIES 5		//maximum retransmissions of an idempotent command
+#define SPINNAKER_MAX_REQUESTS 64	//maximum number of asynchronous requests (including uncollected completions)
+#define SPINNAKER_WRITE_MERGE_GAP (SDP_HDR_SIZE+CMD_RESP_HDR_SIZE+(2*UDP_IP_HDR_SIZE))	//zero gap (bytes) which costs as much to send as a new write and its response
+#define SPINNAKER_APLX_SPEEDUP 16	//bytes expanded by an APLX table in the time taken to send one byte
+#define SPINNAKER_LINK_BYTES_PER_US 12	//bytes sent to a board per microsecond (100Mbit Ethernet)
+#define SPINNAKER_POLL_MIN_INTERVAL 500	//shortest time between polls of a running APLX table (us)
+#define SPINNAKER_POLL_DIVISOR 4	//polls of a table which overruns its expansion estimate (per estimate)
+#define SPINNAKER_FILL_MIN_WORDS 8	//shortest run of a repeated word worth a fill entry instead of literal data
+#define SPINNAKER_BLOCK_WORDS 8		//shortest repeated block worth a copy entry instead of literal data
+#define SPINNAKER_BLOCK_HASH_BITS 16	//size of the hash table used to find repeated blocks
+#define SPINNAKER_FILE_CACHE_BITS 6	//size of the hash table of mapped program files
 #define TIMEOUT_SEC 1
 
+#define SPINNAKER_MIN_VERSION 100	//oldest SCAMP version (0.x) which may be attached to without booting
+#define SPINNAKER_PROBE_TIMEOUT 50	//time to wait for the response to a version probe (ms)
+#define SPINNAKER_READY_TIMEOUT 5000	//time allowed for a board to answer once booted (ms)
+#define SPINNAKER_BOOT_MIN_GAP 1000		//first gap tried between boot packets (us)
+#define SPINNAKER_BOOT_MAX_GAP SPINNAKER_CMD_DELAY	//slowest gap between boot packets (us)
+#define SPINNAKER_BOOT_ATTEMPT_TIMEOUT 1000	//time allowed for SCAMP to answer before the image is sent again more slowly (ms)
+
+#define PACE_INITIAL_CWND 4			//initial congestion window (commands in flight)
+#define PACE_INITIAL_RTT 10000		//initial round trip time estimate (us)
+#define PACE_MIN_RTO 20000			//lower bound of the response timeout (us)
+#define PACE_MAX_RTO (TIMEOUT_SEC*1000000)	//upper bound of the response timeout (us)
+#define PACE_SLACK 1000				//packets due within this time of each other are sent together (resolution of the epoll wait) (us)
+
 #define SPINNAKER_BOOT_CMD_START 1
 #define SPINNAKER_BOOT_CMD_DATA 3
 #define SPINNAKER_BOOT_CMD_END 5
@@ -48,6 +86,7 @@
 #define BOOT_HDR_SIZE 		sizeof(boot_hdr)
 #define CMD_RESP_HDR_SIZE 	sizeof(sdp_cmd_resp_hdr)
 #define SVER_SIZE 			sizeof(sver)
+#define UDP_IP_HDR_SIZE		28
 
 #define CMD_SVER 0
 #define CMD_IPTAG 18
@@ -59,6 +98,12 @@
 #define IPTAG_CLR 3
 #define IPTAG_AUTO 4
 
+#define APLX_ACOPY 1
+#define APLX_FILL 3
+#define APLX_END 0xffffffff
+#define APLX_STAGED 0x100		//copy from the literal data of a table (an ACOPY once the table is complete)
+#define APLX_DONE 0x600DF00D	//value filled over the start of a table by its last entry (polled by the host)
+
 #define TYPE_BYTE 0
 #define TYPE_HALF 1
 #define TYPE_WORD 2
@@ -78,20 +123,26 @@ typedef struct{
 	unsigned short src_cpu;			//source cpu
 
 	unsigned short cmd;
-	unsigned short cmd_flags;
-	unsigned long arg1;
-	unsigned long arg2;
-	unsigned long arg3;
+	unsigned short seq;				//sequence number (echoed in the response)
+	unsigned int arg1;
+	unsigned int arg2;
+	unsigned int arg3;
 } sdp_hdr;
 
 typedef struct{
 	unsigned short prot_ver;
-	unsigned long op;
-	unsigned long a1;
-	unsigned long a2;
-	unsigned long a3;
+	unsigned int op;
+	unsigned int a1;
+	unsigned int a2;
+	unsigned int a3;
 }boot_hdr;
 
+typedef struct{
+	boot_hdr hdr;
+	unsigned int data[SPINNAKER_BOOT_DATA_MAX/4];	//big endian block data
+	unsigned int length;							//bytes of the packet to send (header and data)
+}boot_packet;
+
 typedef struct{
 	unsigned short pad;
 	unsigned char flags;
@@ -101,7 +152,7 @@ typedef struct{
 	unsigned short dst_cpu;
 	unsigned short src_cpu;
 	unsigned short rc;
-	unsigned short cmd_flags;
+	unsigned short seq;
 }sdp_cmd_resp_hdr;
 
 typedef struct{
@@ -111,37 +162,254 @@ typedef struct{
 	unsigned char chip_x;
 	unsigned short size;
 	unsigned short ver_num;
-	unsigned long time;
+	unsigned int time;
 }sver;
 
+typedef struct{
+	unsigned int op;
+	unsigned int a1;
+	unsigned int a2;
+	unsigned int a3;
+}aplx_entry;
+
 #pragma pack(pop)
 
-//global variables
-unsigned int spiNN_sock;													//SpiNN socket handle
-unsigned int debug_sock;													//SpiNN socket handle
-spiNN_error last_error = SPINN_NO_ERROR;									//last error code
-void (*error_handler)(void) = &spiNN_print_error;							//error handler function (default is print_last_error)
-void (*debug_handler)(SpiNN_address, char*) = &spiNN_handle_debug_message;	//debug message handler function (default is spiNN_recieve_debug_message)
-struct sockaddr_in spiNN_addr;												//spiNN address
-pthread_t debug_thread;														//thread handle for debug thread (blocks on socket recv)
+/*
+ * Adaptive pacing and congestion control state for a connection
+ */
+typedef struct{
+	unsigned int srtt;						//smoothed round trip time (us)
+	unsigned int rttvar;					//round trip time variation (us)
+	unsigned int rto;						//response timeout (us)
+	unsigned int cwnd;						//congestion window (commands in flight)
+	unsigned int ssthresh;					//slow start threshold
+	unsigned int cwnd_acks;					//responses counted towards the next additive increase
+	unsigned int interval;					//minimum gap between packets (us)
+	unsigned long long next_send;			//earliest time the next packet may be sent (us)
+	unsigned int sent;						//packets sent
+	unsigned int responses;					//responses received
+	unsigned int rtt_samples;				//responses used for the rtt estimate
+	unsigned int timeouts;					//responses lost (timed out)
+	unsigned int retransmits;				//commands sent again after a lost response
+	unsigned int duplicates;				//responses received for commands which had already completed
+}pacer;
+
+/*
+ * Kinds of asynchronous request (each is issued as one or more commands)
+ */
+typedef enum{
+	REQUEST_CMD,							//single command (with an optional response)
+	REQUEST_READ,							//memory read in chunks
+	REQUEST_WRITE,							//memory write in chunks
+	REQUEST_WRITE_NONZERO,					//memory write in chunks skipping zero values
+	REQUEST_WRITE_EXEC						//memory write in chunks followed by a command to run the APLX table written
+}request_type;
+
+/*
+ * An asynchronous request which is split into commands as space in the transmit window allows
+ */
+typedef struct{
+	spiNN_request id;						//request handle (0 if the entry is free)
+	request_type type;
+	SpiNN_address address;
+	sdp_hdr hdr;							//command header (REQUEST_CMD)
+	char* host;								//host memory (source of writes, destination of reads or command data)
+	char* file_data;						//file contents owned by the request (freed on completion)
+	int data_length;						//command data length (REQUEST_CMD)
+	sdp_cmd_resp_hdr* response;				//optional destination for the response header (REQUEST_CMD)
+	char* rsp_data;							//optional destination for the response data (REQUEST_CMD)
+	unsigned int device_address;
+	unsigned int size;						//bytes to transfer (commands for REQUEST_CMD)
+	unsigned int offset;					//bytes issued so far
+	unsigned int outstanding;				//commands issued which are awaiting a response
+	unsigned int exec_address;				//APLX table run once every chunk is acknowledged (REQUEST_WRITE_EXEC)
+	int executed;							//APLX table command has been issued (REQUEST_WRITE_EXEC)
+	unsigned int done_word;					//first word of the table as last polled (REQUEST_WRITE_EXEC)
+	unsigned long long deadline;			//time by which the table must have finished (us, REQUEST_WRITE_EXEC)
+	unsigned int poll_interval;				//time between polls of the table once it overruns its estimate (us, REQUEST_WRITE_EXEC)
+	unsigned long long next_poll;			//time of the next poll of the table (us, REQUEST_WRITE_EXEC)
+	unsigned int completed;					//completion order
+	spiNN_completion_callback callback;		//optional completion callback (otherwise the completion is queued)
+	spiNN_completion completion;
+}async_request;
+
+/*
+ * A command held in the transmit window until its response has been received
+ */
+typedef struct{
+	int in_use;								//command has been sent and is awaiting a response
+	int queued;								//command is waiting in the pending batch for its pacing deadline
+	async_request* request;					//request the command belongs to
+	unsigned long long sent_time;			//time the command was (last) sent (us)
+	unsigned int retries;					//number of times the command has been retransmitted
+	sdp_hdr hdr;							//command header (seq is set when the slot is acquired)
+	const char* data;						//command data (must remain valid until the response is received)
+	int data_length;
+	sdp_cmd_resp_hdr* response;				//optional destination for the response header
+	char* rsp_data;							//optional destination for the response data
+	int rsp_length;							//maximum number of response data bytes to copy
+	char buffer[SDP_DATA_MAX];				//data buffer owned by the slot (for data which is not already in host memory)
+}cmd_slot;
+
+/*
+ * Connection to a SpiNNaker board (all transport state is owned by the context so that several boards and threads can be driven at once)
+ */
+struct spiNN_context{
+	pthread_mutex_t lock;										//serialises the transport (recursive so that callbacks may use the API)
+	unsigned int spiNN_sock;									//SpiNN socket handle
+	unsigned int debug_sock;									//SpiNN socket handle
+	int listen_debug;											//bind the debug port and start the listener thread
+	spiNN_boot_mode boot_mode;									//boot (or attach to) the board during spiNN_init
+	int debug_listening;										//debug listener thread has been started
+	spiNN_error last_error;										//last error code
+	void (*error_handler)(spiNN_context*, spiNN_error);			//error handler function (default is spiNN_print_error)
+	void (*debug_handler)(SpiNN_address, char*);				//debug message handler function (default is spiNN_handle_debug_message)
+	struct sockaddr_in spiNN_addr;								//spiNN address
+	pthread_t debug_thread;										//thread handle for debug thread (blocks on socket recv)
+	cmd_slot cmd_window[SPINNAKER_CMD_WINDOW];					//commands awaiting a response (indexed by seq)
+	unsigned int cmd_in_flight;									//number of commands awaiting a response
+	unsigned short cmd_seq;										//next command sequence number
+	unsigned short cmd_ack_seq;									//oldest sequence number which may still be awaiting a response
+	cmd_slot* cmd_pending[SPINNAKER_CMD_WINDOW];				//submitted commands waiting to be transmitted (in paced sub-batches)
+	unsigned int cmd_pending_count;								//number of submitted commands not yet transmitted
+	struct mmsghdr cmd_tx_msgs[SPINNAKER_CMD_WINDOW];			//transmit batch
+	struct iovec cmd_tx_iov[SPINNAKER_CMD_WINDOW][2];			//transmit batch header and data parts
+	struct mmsghdr cmd_rx_msgs[SPINNAKER_CMD_WINDOW];			//receive batch
+	struct iovec cmd_rx_iov[SPINNAKER_CMD_WINDOW][3];			//receive batch header, destination and overflow parts
+	sdp_cmd_resp_hdr cmd_rx_hdr[SPINNAKER_CMD_WINDOW];			//receive batch response headers
+	char cmd_rx_buffer[SPINNAKER_CMD_WINDOW][SDP_DATA_MAX];		//response data which has no destination in host memory
+	char* cmd_rx_data[SPINNAKER_CMD_WINDOW];					//gathered data of out of order responses (NULL if already in place)
+	pacer cmd_pacer;											//pacing state of the command connection
+	pacer boot_pacer;											//pacing state of the boot connection (no responses)
+	async_request requests[SPINNAKER_MAX_REQUESTS];				//outstanding asynchronous requests and uncollected completions
+	spiNN_request next_request_id;								//handle of the next request
+	unsigned int request_cursor;								//request which issues the first command of the next pass
+	unsigned int requests_completed;							//number of requests completed (orders completions)
+	int event_fd;												//epoll instance of the event loop (command socket)
+	unsigned long long poll_due;								//earliest poll of a running table which is not yet due (us, 0 if none)
+};
+
+/*
+ * APLX table under construction (entries and the literal data they copy from the staging area)
+ */
+struct spiNN_table{
+	unsigned int staging_address;			//device address the table is written to
+	aplx_entry* entries;
+	unsigned int count;						//number of entries
+	char* literals;							//literal data (copied to the device after the table)
+	unsigned int literal_size;				//bytes of literal data
+	unsigned int literal_capacity;			//bytes allocated for literal data
+	unsigned int expanded;					//bytes written by the table on the chip
+};
+
+/*
+ * Boot image converted into packets (built on first use and shared by all contexts)
+ */
+typedef struct{
+	pthread_mutex_t lock;					//serialises building the image and updating the gap
+	boot_packet* packets;					//prebuilt data packets (NULL until built)
+	unsigned int blocks;					//number of data packets
+	unsigned int gap;						//shortest gap between packets known to boot a board (us)
+}boot_image;
 
+boot_image boot_image_cache = {PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0};
 
-//private prototypes
-int check_SpiNN_address(SpiNN_address* address);							//checks range of core_id
-int connect_sdp(char* device_ip, unsigned int port);						//connects SpiNNaker command/sdp socket
-int connect_debug();														//connects debug socket
-int send_cmd(sdp_hdr* hdr, const char* data, int data_length, sdp_cmd_resp_hdr* response, char* rsp_data);	//sends command via sdp (checks for response)
-int send_boot_pkt(unsigned int boot_sock, struct sockaddr_in *boot_addr, boot_hdr* hdr, const char* data, int data_length);
-int boot(char* device_ip);																	//sends the boot image to spinnaker
+/*
+ * Program file mapped into host memory (pages past the end of the file read as zero)
+ */
+typedef struct cached_file{
+	char* name;
+	unsigned int name_hash;
+	unsigned int content_hash;
+	char* data;								//mapped file contents (shared by files with the same contents)
+	unsigned int size;						//bytes in the file
+	struct cached_file* next;				//next file in the hash bucket
+}cached_file;
+
+/*
+ * Program files which have been mapped (kept until the process exits and shared by all contexts)
+ */
+typedef struct{
+	pthread_mutex_t lock;
+	cached_file* buckets[1 << SPINNAKER_FILE_CACHE_BITS];	//files by name hash
+}file_cache;
 
-void* listen_debug(void* null);												//debug listener function
+file_cache program_file_cache = {PTHREAD_MUTEX_INITIALIZER, {NULL}};
 
 
-int spiNN_init_port(char* device_ip, int x_dimension, int y_dimension, unsigned int port)
+//private prototypes
+int check_SpiNN_address(spiNN_context* ctx, SpiNN_address* address);		//checks range of core_id
+int connect_sdp(spiNN_context* ctx, char* device_ip, unsigned int port);	//connects SpiNNaker command/sdp socket
+int connect_debug(spiNN_context* ctx);									//connects debug socket
+int send_cmd(spiNN_context* ctx, sdp_hdr* hdr, const char* data, int data_length, sdp_cmd_resp_hdr* response, char* rsp_data);	//sends command via sdp (checks for response)
+spiNN_request submit_cmd_request(spiNN_context* ctx, sdp_hdr* hdr, const char* data, int data_length, sdp_cmd_resp_hdr* response, char* rsp_data, spiNN_completion_callback callback, void* user_data);	//submits a single command as a request
+async_request* create_request(spiNN_context* ctx, request_type type, SpiNN_address* address, spiNN_completion_callback callback, void* user_data);	//allocates a request entry (NULL if none)
+spiNN_request submit_request(spiNN_context* ctx, async_request* r);			//hands a request to the event loop
+async_request* find_request(spiNN_context* ctx, spiNN_request request);		//gets the request entry of a handle (NULL if none)
+unsigned int zero_bytes(const char* data, unsigned int length);				//counts leading zero bytes
+unsigned int word_run(const char* data, unsigned int words, int zero);		//counts leading zero (or non zero) words
+unsigned int plan_nonzero(const char* data, unsigned int length);			//bytes of the next sparse write packet (whole words)
+int next_chunk(async_request* r);											//checks if a request has more commands to issue
+unsigned int chunk_length(async_request* r);								//bytes of the next memory command of a request
+unsigned int nonzero_cost(char* data, unsigned int size, unsigned int device_address);	//bytes sent (including command overheads) by a sparse write
+unsigned int table_cost(spiNN_table* t);									//bytes sent (including command overheads) to run a table plus its expansion time
+unsigned int table_expansion(spiNN_table* t);								//time taken to expand a table on the chip (in bytes sent)
+void schedule_polls(async_request* r, unsigned int run_time_us);			//sets when a run table is first polled and the time between polls
+unsigned int equal_run(const char* data, unsigned int words);				//counts leading words equal to the first
+unsigned int block_hash(const char* data);									//hash of the block of words starting at data
+unsigned int fnv1a(const char* data, unsigned int size);					//32 bit FNV-1a hash of bytes
+cached_file* map_file(char* filename);										//gets the cached mapping of a file (NULL if it can not be opened)
+unsigned int block_match(const char* data, unsigned int pos, unsigned int words, unsigned int* hashes, unsigned int* src);	//finds an earlier copy of the block at pos (length in words)
+void add_table_entry(spiNN_table* t, unsigned int op, unsigned int a1, unsigned int a2, unsigned int a3);	//appends an entry to a table
+void add_table_literals(spiNN_table* t, unsigned int device_address, const char* data, unsigned int size);	//appends a copy of staged literal data to a table
+void issue_chunk(spiNN_context* ctx, async_request* r, cmd_slot* slot);		//fills a window slot with the next command of a request
+void issue_cmds(spiNN_context* ctx);										//fills the window with commands from the outstanding requests
+void finish_request(spiNN_context* ctx, async_request* r, spiNN_error error);	//records the completion of a request
+void fail_request(spiNN_context* ctx, async_request* r, spiNN_error error);	//abandons the commands of a request and completes it with an error
+int reap_request(spiNN_context* ctx, async_request* r);						//releases a completed request (raises its error)
+async_request* next_completion(spiNN_context* ctx, int with_callback);		//gets the oldest completed request (NULL if none)
+int pending_requests(spiNN_context* ctx);									//number of requests which have not completed
+int deliver_completions(spiNN_context* ctx);								//calls the callbacks of completed requests
+int progress(spiNN_context* ctx, int timeout_ms);							//runs one iteration of the event loop
+cmd_slot* acquire_cmd(spiNN_context* ctx);								//gets the next window slot (NULL if the window is full)
+int submit_cmd(spiNN_context* ctx, cmd_slot* slot);							//queues the command held in a window slot for transmission
+int transmit_cmds(spiNN_context* ctx);									//sends the queued commands whose pacing deadline has been reached
+void unqueue_cmd(spiNN_context* ctx, cmd_slot* slot);						//removes a command from the pending batch
+int receive_cmd_responses(spiNN_context* ctx);							//receives a batch of ready responses and retires the matching slots
+cmd_slot* match_cmd(spiNN_context* ctx, unsigned int m, unsigned int received);		//matches a received response to its command (NULL if none)
+void gather_cmd_response(spiNN_context* ctx, unsigned int m, unsigned int received);	//gathers the data of an out of order response
+void retire_cmd(spiNN_context* ctx, unsigned int m, unsigned int received);		//completes the command matching a received response
+int expire_cmds(spiNN_context* ctx, unsigned long long* next_deadline);		//retransmits (or fails) commands whose response has timed out
+int is_idempotent(unsigned short cmd);										//checks if a command may safely be sent again
+void reset_cmds(spiNN_context* ctx);										//abandons all commands in the window
+cmd_slot* oldest_cmd(spiNN_context* ctx);									//gets the oldest command awaiting a response (NULL if none)
+
+unsigned long long now_us();												//monotonic time (us)
+void pace_init(pacer* p, unsigned int interval);							//resets pacing state
+void pace_wait(pacer* p, unsigned int packets);							//sleeps until the next packets may be sent (boot only, no lock is held)
+unsigned int pace_ready(pacer* p, unsigned int packets);					//number of packets which may be sent now (does not wait)
+void pace_response(pacer* p, unsigned int rtt, int rtt_valid);				//updates rtt estimate and grows the window
+void pace_loss(pacer* p);													//backs off after a lost response
+int probe_version(spiNN_context* ctx, SpiNN_chip_address chip, int timeout_ms, sver* ver);	//queries the SCAMP version of a chip (fails quietly if there is no response)
+int wait_for_version(spiNN_context* ctx, SpiNN_chip_address chip, int timeout_ms);		//probes a chip until it answers (fails quietly on timeout)
+void bswap_words(unsigned int* dst, const unsigned int* src, unsigned int words);		//converts words to big endian (vectorised where supported)
+int load_boot_image(spiNN_context* ctx);													//maps and converts the boot image into packets (once per process)
+int send_boot_pkt(spiNN_context* ctx, unsigned int boot_sock, struct sockaddr_in *boot_addr, const void* pkt, int length);
+int send_boot_image(spiNN_context* ctx, unsigned int boot_sock, struct sockaddr_in *boot_addr);	//sends the start, data and end packets
+int boot(spiNN_context* ctx, char* device_ip);												//sends the boot image to spinnaker (until SCAMP answers)
+
+void raise_error(spiNN_context* ctx, spiNN_error error);					//records an error and calls the error handler
+void* listen_debug(void* context);											//debug listener function (argument is the context)
+
+
+int spiNN_init_port(spiNN_context* ctx, char* device_ip, int x_dimension, int y_dimension, unsigned int port)
 {
 	sdp_hdr hdr;
 	sdp_cmd_resp_hdr resp_hdr;
 	char resp_data[SDP_DATA_MAX];
+	SpiNN_chip_address origin;
+	sver ver;
+	int attached;
 	int id;
 
 
@@ -155,31 +423,38 @@ int spiNN_init_port(char* device_ip, int x_dimension, int y_dimension, unsigned
 	hdr.tag = 255;
 	hdr.src_core_id = 255;
 
-	if (!connect_sdp(device_ip, port))	//connect to SpiNNaker
+	if (!connect_sdp(ctx, device_ip, port))	//connect to SpiNNaker
 		return SPINN_FAILURE;
 
-	//send boot image
-	if (!boot(device_ip))
+	//a board which already runs a compatible SCAMP does not need to be booted again
+	origin.x = 0;
+	origin.y = 0;
+	attached = 0;
+	if ((ctx->boot_mode == SPINN_BOOT_ATTACH) && (probe_version(ctx, origin, SPINNAKER_PROBE_TIMEOUT, &ver)))
+		attached = (ver.ver_num >= SPINNAKER_MIN_VERSION);
+
+	//send boot image (returns once SCAMP answers)
+	if ((!attached)&&(!boot(ctx, device_ip)))
 		return SPINN_FAILURE;
 
-	if (!spiNN_test_connection())
+	if (!spiNN_test_connection(ctx))
 		return SPINN_FAILURE;
 
-	//connect debug
-	if (!connect_debug())
+	//connect debug (only one context per host can bind the debug port)
+	if ((ctx->listen_debug) && (!connect_debug(ctx)))
 		return SPINN_FAILURE;
 
 	//clear iptag
 	hdr.cmd = CMD_IPTAG;
 	hdr.arg1 = (IPTAG_CLR << 16);
-	if (!send_cmd(&hdr, "", 0, &resp_hdr, resp_data))
+	if (!send_cmd(ctx, &hdr, "", 0, &resp_hdr, resp_data))
 		return SPINN_FAILURE;
 
 	//set iptag auto
 	hdr.cmd = CMD_IPTAG;
 	hdr.arg1 = (IPTAG_AUTO << 16);
 	hdr.arg2 = SPINNAKER_DEBUG_OUTPUT_PORT;
-	if (!send_cmd(&hdr, "", 0, &resp_hdr, resp_data))
+	if (!send_cmd(ctx, &hdr, "", 0, &resp_hdr, resp_data))
 		return SPINN_FAILURE;
 
 
@@ -188,22 +463,26 @@ int spiNN_init_port(char* device_ip, int x_dimension, int y_dimension, unsigned
 	hdr.arg1 = (0x00 << 24) + (0x3e << 16) + (0x00 << 8) + id;
 	hdr.arg2 = (x_dimension << 24) + (y_dimension << 16) + (0x00 << 8) + 0x00;
 	hdr.arg3 = (0x00 << 24) + (0x00 << 16) + (0x3f << 8) + 0xf8;
-	if (!send_cmd(&hdr, "", 0, &resp_hdr, resp_data))
+	if (!send_cmd(ctx, &hdr, "", 0, &resp_hdr, resp_data))
 		return SPINN_FAILURE;
 
 	//start debug listener thread
-	pthread_create(&debug_thread, NULL, listen_debug, 0);
+	if (ctx->listen_debug)
+	{
+		pthread_create(&ctx->debug_thread, NULL, listen_debug, ctx);
+		ctx->debug_listening = 1;
+	}
 
 
 	return SPINN_SUCCESS;
 }
 
-int spiNN_init(char* device_ip, int x_dimension, int y_dimension)
+int spiNN_init(spiNN_context* ctx, char* device_ip, int x_dimension, int y_dimension)
 {
-	return spiNN_init_port(device_ip, x_dimension, y_dimension, SPINNAKER_CMD_PORT);
+	return spiNN_init_port(ctx, device_ip, x_dimension, y_dimension, SPINNAKER_CMD_PORT);
 }
 
-int spiNN_test_connection()
+int spiNN_test_connection(spiNN_context* ctx)
 {
 	sdp_hdr hdr;
 	sdp_cmd_resp_hdr resp_hdr;
@@ -221,7 +500,7 @@ int spiNN_test_connection()
 	memset(&resp_hdr, 0 , CMD_RESP_HDR_SIZE);
 	hdr.cmd = CMD_SVER;
 
-	if (!send_cmd(&hdr, "", 0, &resp_hdr, resp_data))
+	if (!send_cmd(ctx, &hdr, "", 0, &resp_hdr, resp_data))
 		return SPINN_FAILURE;
 
 	memcpy(&ver, resp_data, SVER_SIZE);
@@ -230,311 +509,517 @@ int spiNN_test_connection()
 	return SPINN_SUCCESS;
 }
 
-void spiNN_exit()
+spiNN_context* spiNN_create_context()
+{
+	spiNN_context* ctx;
+	pthread_mutexattr_t attr;
+
+	ctx = (spiNN_context*)calloc(1, sizeof(spiNN_context));
+	if (ctx == NULL)
+		return NULL;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&ctx->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	ctx->listen_debug = 1;
+	ctx->boot_mode = SPINN_BOOT_ALWAYS;
+	ctx->last_error = SPINN_NO_ERROR;
+	ctx->error_handler = &spiNN_print_error;
+	ctx->debug_handler = &spiNN_handle_debug_message;
+	ctx->next_request_id = 1;
+	ctx->spiNN_sock = -1;
+	ctx->debug_sock = -1;
+	ctx->event_fd = -1;
+
+	return ctx;
+}
+
+void spiNN_set_debug_listener(spiNN_context* ctx, int listen)
+{
+	ctx->listen_debug = listen;
+}
+
+void spiNN_set_boot_mode(spiNN_context* ctx, spiNN_boot_mode mode)
+{
+	ctx->boot_mode = mode;
+}
+
+int spiNN_wait_for_chip(spiNN_context* ctx, SpiNN_chip_address chip, int timeout_ms)
+{
+	if (!wait_for_version(ctx, chip, timeout_ms))
+	{
+		raise_error(ctx, SPINN_ERROR_SDP_CMD_TIMEOUT);
+		return SPINN_FAILURE;
+	}
+	return SPINN_SUCCESS;
+}
+
+void spiNN_exit(spiNN_context* ctx)
 {
-	pthread_cancel(debug_thread);
-	close(debug_sock);
+	if (ctx->debug_listening)
+	{
+		pthread_cancel(ctx->debug_thread);
+		pthread_join(ctx->debug_thread, NULL);
+	}
+	close(ctx->debug_sock);
 	//pthread_exit(0);
-	close(spiNN_sock);
+	close(ctx->event_fd);
+	close(ctx->spiNN_sock);
+
+	pthread_mutex_destroy(&ctx->lock);
+	free(ctx);
 }
 
-int spiNN_load_application(SpiNN_chip_address chip, char* filename)
+int spiNN_load_application(spiNN_context* ctx, SpiNN_chip_address chip, char* filename)
 {
 	SpiNN_address address;
 	address.x = chip.x;
 	address.y = chip.y;
 	address.core_id = 0;
-	return spiNN_load_application_at(address, filename, DEFAULT_LOAD_ADDRESS);
+	return spiNN_load_application_at(ctx, address, filename, DEFAULT_LOAD_ADDRESS);
 }
 
-int spiNN_load_application_at(SpiNN_address address, char* filename, unsigned int device_address)
+int spiNN_load_application_at(spiNN_context* ctx, SpiNN_address address, char* filename, unsigned int device_address)
 {
-	unsigned int mem_addr;
-	int len;
-	sdp_hdr hdr;
-	sdp_cmd_resp_hdr resp_hdr;
-	char resp_data[SDP_DATA_MAX];
-	FILE *fp;
-	char f_buffer[SDP_DATA_MAX];
-
-	mem_addr = device_address;
-	//common hdr values
-	memset(&hdr, 0, SDP_HDR_SIZE);
-	hdr.tto = 8;
-	hdr.flags = 0x87;
-	hdr.tag = 255;
-	hdr.src_core_id = 255;
-	hdr.dst_cpu = (address.x << 8) + address.y;
-	hdr.dst_core_id = address.core_id;
+	return spiNN_wait(ctx, spiNN_load_application_at_async(ctx, address, filename, device_address, NULL, NULL));
+}
 
-	//send version query and get response
-	memset(&resp_hdr, 0 , CMD_RESP_HDR_SIZE);
+spiNN_request spiNN_load_application_at_async(spiNN_context* ctx, SpiNN_address address, char* filename, unsigned int device_address, spiNN_completion_callback callback, void* user_data)
+{
+	spiNN_request request;
+	async_request* r;
+	cached_file* file;
 
-	//open binary file for reading
-	fp = fopen(filename, "rb");
-	if (fp == NULL)
+	//the file is mapped once and written directly from the mapped pages
+	file = map_file(filename);
+	if (file == NULL)
 	{
-		last_error = SPINN_ERROR_LOAD_FILE_OPEN;
-		error_handler();
-		return SPINN_FAILURE;
+		raise_error(ctx, SPINN_ERROR_LOAD_FILE_OPEN);
+		return 0;
 	}
 
-	while (1){
-		len = fread(f_buffer, 1, SDP_DATA_MAX, fp);
-		if (len<=0)
-			break;
-		hdr.cmd = CMD_WRITE;
-		hdr.arg1 = mem_addr;
-		hdr.arg2 = len;
-		hdr.arg3 = TYPE_BYTE;
-
-		if (!send_cmd(&hdr, f_buffer, len, &resp_hdr, resp_data))
-			return SPINN_FAILURE;
-
-		mem_addr += len;
+	pthread_mutex_lock(&ctx->lock);
+	request = 0;
+	r = create_request(ctx, REQUEST_WRITE, &address, callback, user_data);
+	if (r != NULL)
+	{
+		r->host = file->data;
+		r->device_address = device_address;
+		r->size = file->size;
+		request = submit_request(ctx, r);
 	}
+	pthread_mutex_unlock(&ctx->lock);
 
-	fclose(fp);
+	return request;
+}
 
-	return SPINN_SUCCESS;
+int spiNN_start_application(spiNN_context* ctx, SpiNN_address address)
+{
+	return spiNN_start_application_at(ctx, address, DEFAULT_LOAD_ADDRESS);
 }
 
-int spiNN_start_application(SpiNN_address address)
+int spiNN_start_application_at(spiNN_context* ctx, SpiNN_address address, unsigned int device_address)
 {
-	return spiNN_start_application_at(address, DEFAULT_LOAD_ADDRESS);
+	return spiNN_wait(ctx, spiNN_start_application_at_async(ctx, address, device_address, NULL, NULL));
 }
 
-int spiNN_start_application_at(SpiNN_address address, unsigned int device_address)
+spiNN_request spiNN_start_application_at_async(spiNN_context* ctx, SpiNN_address address, unsigned int device_address, spiNN_completion_callback callback, void* user_data)
 {
+	spiNN_request request;
 	sdp_hdr hdr;
-	sdp_cmd_resp_hdr resp_hdr;
-	char resp_data[SDP_DATA_MAX];
 
-	if (check_SpiNN_address(&address) == SPINN_FAILURE)
-		return SPINN_FAILURE;
+	if (check_SpiNN_address(ctx, &address) == SPINN_FAILURE)
+		return 0;
 
 	if (address.core_id == 0)
 	{
-		last_error = SPINN_ERROR_START_APP_ON_MONITOR;
-		error_handler();
-		return SPINN_FAILURE;
+		raise_error(ctx, SPINN_ERROR_START_APP_ON_MONITOR);
+		return 0;
 	}
 
-	//common hdr values
 	memset(&hdr, 0, SDP_HDR_SIZE);
-	hdr.tto = 8;
-	hdr.flags = 0x87;
-	hdr.tag = 255;
-	hdr.src_core_id = 255;
-
-	//send version query and get response
-	//memset(resp_data, 0, SDP_DATA_MAX);
-	memset(&resp_hdr, 0 , CMD_RESP_HDR_SIZE);
 	hdr.dst_core_id = address.core_id;
 	hdr.dst_cpu = (address.x << 8) + address.y;
 
 	hdr.cmd = CMD_APLX;
 	hdr.arg1 = device_address;
 
-	if (!send_cmd(&hdr, "", 0, &resp_hdr, resp_data))
-				return SPINN_FAILURE;
+	//the response is sent once the core has accepted the command (following commands are paced)
+	pthread_mutex_lock(&ctx->lock);
+	request = submit_cmd_request(ctx, &hdr, "", 0, NULL, NULL, callback, user_data);
+	pthread_mutex_unlock(&ctx->lock);
 
-	//need to sleep to give the device time to actually start.
-	usleep(SPINNAKER_CMD_DELAY);
+	return request;
+}
 
 
-	return SPINN_SUCCESS;
+
+int spiNN_read_memory(spiNN_context* ctx, SpiNN_address address, char* host_destination, unsigned int device_address, unsigned int size)
+{
+	return spiNN_wait(ctx, spiNN_read_memory_async(ctx, address, host_destination, device_address, size, NULL, NULL));
 }
 
+spiNN_request spiNN_read_memory_async(spiNN_context* ctx, SpiNN_address address, char* host_destination, unsigned int device_address, unsigned int size, spiNN_completion_callback callback, void* user_data)
+{
+	spiNN_request request;
+	async_request* r;
+
+	//responses are copied directly into host memory
+	pthread_mutex_lock(&ctx->lock);
+	request = 0;
+	r = create_request(ctx, REQUEST_READ, &address, callback, user_data);
+	if (r != NULL)
+	{
+		r->host = host_destination;
+		r->device_address = device_address;
+		r->size = size;
+		request = submit_request(ctx, r);
+	}
+	pthread_mutex_unlock(&ctx->lock);
 
+	return request;
+}
 
-int spiNN_read_memory(SpiNN_address address, char* host_destination, unsigned int device_address, unsigned int size)
+int spiNN_write_memory(spiNN_context* ctx, SpiNN_address address, char* host_destination, unsigned int device_address, unsigned int size)
 {
-	int len;
-	int remaining;
-	sdp_hdr hdr;
-	sdp_cmd_resp_hdr resp_hdr;
-	char resp_data[SDP_DATA_MAX];
+	return spiNN_wait(ctx, spiNN_write_memory_async(ctx, address, host_destination, device_address, size, NULL, NULL));
+}
 
-	if (check_SpiNN_address(&address) == SPINN_FAILURE)
-		return SPINN_FAILURE;
+spiNN_request spiNN_write_memory_async(spiNN_context* ctx, SpiNN_address address, char* host_destination, unsigned int device_address, unsigned int size, spiNN_completion_callback callback, void* user_data)
+{
+	spiNN_request request;
+	async_request* r;
+
+	//data is sent directly from host memory
+	pthread_mutex_lock(&ctx->lock);
+	request = 0;
+	r = create_request(ctx, REQUEST_WRITE, &address, callback, user_data);
+	if (r != NULL)
+	{
+		r->host = host_destination;
+		r->device_address = device_address;
+		r->size = size;
+		request = submit_request(ctx, r);
+	}
+	pthread_mutex_unlock(&ctx->lock);
 
-	//common hdr values
-	memset(&hdr, 0, SDP_HDR_SIZE);
-	hdr.tto = 8;
-	hdr.flags = 0x87;
-	hdr.tag = 255;
-	hdr.src_core_id = 255;
-	hdr.dst_cpu = (address.x << 8) + address.y;
-	hdr.dst_core_id = address.core_id;
+	return request;
+}
 
-	//send version query and get response
-	memset(&resp_hdr, 0 , CMD_RESP_HDR_SIZE);
+int spiNN_writenonzero_memory(spiNN_context* ctx, SpiNN_address address, char* host_destination, unsigned int device_address, unsigned int size)
+{
+	return spiNN_wait(ctx, spiNN_writenonzero_memory_async(ctx, address, host_destination, device_address, size, NULL, NULL));
+}
 
-	int offset = 0;
+spiNN_request spiNN_writenonzero_memory_async(spiNN_context* ctx, SpiNN_address address, char* host_destination, unsigned int device_address, unsigned int size, spiNN_completion_callback callback, void* user_data)
+{
+	spiNN_request request;
+	async_request* r;
+
+	//zero values are skipped as each chunk is issued
+	pthread_mutex_lock(&ctx->lock);
+	request = 0;
+	r = create_request(ctx, REQUEST_WRITE_NONZERO, &address, callback, user_data);
+	if (r != NULL)
+	{
+		r->host = host_destination;
+		r->device_address = device_address;
+		r->size = size;
+		request = submit_request(ctx, r);
+	}
+	pthread_mutex_unlock(&ctx->lock);
 
-	while (1){
-		remaining = size-offset;
-		len = (remaining > SDP_DATA_MAX)? SDP_DATA_MAX : remaining;
+	return request;
+}
 
-		hdr.cmd = CMD_READ;
-		hdr.arg1 = device_address+offset;
-		hdr.arg2 = len;
-		hdr.arg3 = TYPE_BYTE;
-		if (!send_cmd(&hdr, "", 0, &resp_hdr, resp_data))
-			return SPINN_FAILURE;
+spiNN_table* spiNN_create_table(unsigned int staging_address)
+{
+	spiNN_table* t;
 
-		//copy into host memory
-		memcpy(&host_destination[offset], resp_data, len);
+	t = (spiNN_table*)calloc(1, sizeof(spiNN_table));
+	t->staging_address = staging_address;
+	return t;
+}
 
-		offset += len;
+void spiNN_free_table(spiNN_table* t)
+{
+	if (t == NULL)
+		return;
+	free(t->entries);
+	free(t->literals);
+	free(t);
+}
 
-		if (offset == size)
-			return SPINN_SUCCESS;
-	}
+void spiNN_table_fill(spiNN_table* t, unsigned int device_address, unsigned int size, unsigned int value)
+{
+	add_table_entry(t, APLX_FILL, device_address, size, value);
+	t->expanded += size;
+}
 
-	//should never get here!
-	return SPINN_FAILURE;
+void spiNN_table_copy(spiNN_table* t, unsigned int device_address, unsigned int device_source, unsigned int size)
+{
+	add_table_entry(t, APLX_ACOPY, device_address, device_source, size);
+	t->expanded += size;
 }
 
-int spiNN_write_memory(SpiNN_address address, char* host_destination, unsigned int device_address, unsigned int size)
+void spiNN_table_data(spiNN_table* t, const char* host_source, unsigned int device_address, unsigned int size)
 {
-	int len;
-	int remaining;
-	sdp_hdr hdr;
-	char pkt_data[SDP_DATA_MAX];
-	sdp_cmd_resp_hdr resp_hdr;
-	char resp_data[SDP_DATA_MAX];
+	unsigned int* hashes;
+	unsigned int words;
+	unsigned int pos;
+	unsigned int run;
+	unsigned int span;
+	unsigned int src;
+	unsigned int value;
+
+	//runs of a repeated word become fills, repeated blocks become copies of the earlier block on the chip and everything else is
+	//literal data copied from the staging area (zero words are skipped)
+	hashes = (unsigned int*)calloc(1 << SPINNAKER_BLOCK_HASH_BITS, sizeof(unsigned int));
+	words = size / 4;
+	span = pos = 0;
+	while (pos < words)
+	{
+		run = word_run(&host_source[pos*4], words-pos, 1);
+		if (run > 0)
+		{
+			//short zero gaps stay inside the current literal span
+			if ((pos > span) && ((pos+run >= words) || (run*4 >= sizeof(aplx_entry))))
+			{
+				add_table_literals(t, device_address+span*4, &host_source[span*4], (pos-span)*4);
+				span = pos+run;
+			}
+			else if (pos == span)
+				span = pos+run;
+			pos += run;
+			continue;
+		}
 
-	if (size == 0)
-		return SPINN_SUCCESS;
+		run = equal_run(&host_source[pos*4], words-pos);
+		if (run >= SPINNAKER_FILL_MIN_WORDS)
+		{
+			if (pos > span)
+				add_table_literals(t, device_address+span*4, &host_source[span*4], (pos-span)*4);
+			memcpy(&value, &host_source[pos*4], sizeof(unsigned int));
+			spiNN_table_fill(t, device_address+pos*4, run*4, value);
+			pos += run;
+			span = pos;
+			continue;
+		}
 
-	if (check_SpiNN_address(&address) == SPINN_FAILURE)
-		return SPINN_FAILURE;
+		run = block_match(host_source, pos, words, hashes, &src);
+		if (run > 0)
+		{
+			if (pos > span)
+				add_table_literals(t, device_address+span*4, &host_source[span*4], (pos-span)*4);
+			add_table_entry(t, APLX_ACOPY, device_address+pos*4, device_address+src*4, run*4);
+			t->expanded += run*4;
+			pos += run;
+			span = pos;
+			continue;
+		}
 
-	//common hdr values
-	memset(&hdr, 0, SDP_HDR_SIZE);
-	hdr.tto = 8;
-	hdr.flags = 0x87;
-	hdr.tag = 255;
-	hdr.src_core_id = 255;
-	hdr.dst_cpu = (address.x << 8) + address.y;
-	hdr.dst_core_id = address.core_id;
+		//literal word extends the current span
+		pos++;
+	}
+	if (pos > span)
+		add_table_literals(t, device_address+span*4, &host_source[span*4], (pos-span)*4);
+	free(hashes);
+}
 
-	//send version query and get response
-	memset(&resp_hdr, 0 , CMD_RESP_HDR_SIZE);
+int spiNN_table_file(spiNN_table* t, char* filename, unsigned int device_address)
+{
+	cached_file* file;
+	unsigned int size;
 
-	int offset = 0;
+	file = map_file(filename);
+	if (file == NULL)
+		return SPINN_FAILURE;
 
-	while (1){
-		remaining = (size-offset);
-		len = (remaining > SDP_DATA_MAX)? SDP_DATA_MAX : remaining;
+	//the file is padded to whole words (the rest of the last mapped page reads as zero)
+	size = (file->size + 3) & ~3;
+	spiNN_table_fill(t, device_address, size, 0);
+	spiNN_table_data(t, file->data, device_address, size);
 
-		hdr.cmd = CMD_WRITE;
-		//hdr.cmd_flags = 0;
-		hdr.arg1 = device_address+offset;
-		hdr.arg2 = len;
-		hdr.arg3 = TYPE_BYTE;
+	return SPINN_SUCCESS;
+}
 
-		//copy into packet data
-		memcpy(pkt_data, &host_destination[offset], len);
+int spiNN_cache_file(char* filename, unsigned int* size, unsigned int* content_hash)
+{
+	cached_file* file;
 
-		if (!send_cmd(&hdr, pkt_data, len, &resp_hdr, resp_data))
-			return SPINN_FAILURE;
+	file = map_file(filename);
+	if (file == NULL)
+		return SPINN_FAILURE;
+	if (size != NULL)
+		*size = file->size;
+	if (content_hash != NULL)
+		*content_hash = file->content_hash;
+	return SPINN_SUCCESS;
+}
 
-		offset += len;
-		if (offset == size)
-			return SPINN_SUCCESS;
-	}
+unsigned int spiNN_table_size(spiNN_table* t)
+{
+	return (t->count+2)*sizeof(aplx_entry) + t->literal_size;
+}
 
-	//should never get here!
-	return SPINN_FAILURE;
+int spiNN_run_table(spiNN_context* ctx, SpiNN_address address, spiNN_table* t)
+{
+	return spiNN_wait(ctx, spiNN_run_table_async(ctx, address, t, NULL, NULL));
 }
 
-int spiNN_writenonzero_memory(SpiNN_address address, char* host_destination, unsigned int device_address, unsigned int size)
+spiNN_request spiNN_run_table_async(spiNN_context* ctx, SpiNN_address address, spiNN_table* t, spiNN_completion_callback callback, void* user_data)
 {
-	int i;
-	int len;
-	int remaining;
-	sdp_hdr hdr;
-	char pkt_data[SDP_DATA_MAX];
-	sdp_cmd_resp_hdr resp_hdr;
-	char resp_data[SDP_DATA_MAX];
+	spiNN_request request;
+	async_request* r;
+	char* stream;
+	unsigned int table_size;
+	unsigned int i;
 
-	if (size == 0)
-		return SPINN_SUCCESS;
+	if (address.core_id == 0)
+	{
+		spiNN_free_table(t);
+		raise_error(ctx, SPINN_ERROR_START_APP_ON_MONITOR);
+		return 0;
+	}
 
-	if (check_SpiNN_address(&address) == SPINN_FAILURE)
-		return SPINN_FAILURE;
+	//stream is the table followed by the literal data (staged copies are relocated to the end of the table) and the table marks
+	//its start once it has finished
+	add_table_entry(t, APLX_FILL, t->staging_address, sizeof(unsigned int), APLX_DONE);
+	add_table_entry(t, APLX_END, 0, 0, 0);
+	table_size = t->count*sizeof(aplx_entry);
+	for (i=0;i<t->count;i++)
+	{
+		if (t->entries[i].op == APLX_STAGED)
+		{
+			t->entries[i].op = APLX_ACOPY;
+			t->entries[i].a2 += t->staging_address + table_size;
+		}
+	}
+	stream = (char*)malloc(table_size + t->literal_size);
+	memcpy(stream, t->entries, table_size);
+	memcpy(&stream[table_size], t->literals, t->literal_size);
+
+	//the stream is written to the staging area and then run by the core
+	pthread_mutex_lock(&ctx->lock);
+	request = 0;
+	r = create_request(ctx, REQUEST_WRITE_EXEC, &address, callback, user_data);
+	if (r == NULL)
+		free(stream);
+	else
+	{
+		r->file_data = stream;
+		r->host = stream;
+		r->device_address = t->staging_address;
+		r->size = table_size + t->literal_size;
+		r->exec_address = t->staging_address;
+		schedule_polls(r, table_expansion(t)/SPINNAKER_LINK_BYTES_PER_US);
+		request = submit_request(ctx, r);
+	}
+	pthread_mutex_unlock(&ctx->lock);
+	spiNN_free_table(t);
 
-	//common hdr values
-	memset(&hdr, 0, SDP_HDR_SIZE);
-	hdr.tto = 8;
-	hdr.flags = 0x87;
-	hdr.tag = 255;
-	hdr.src_core_id = 255;
-	hdr.dst_cpu = (address.x << 8) + address.y;
-	hdr.dst_core_id = address.core_id;
+	return request;
+}
 
-	//send version query and get response
-	memset(&resp_hdr, 0 , CMD_RESP_HDR_SIZE);
+int spiNN_write_compressed_memory(spiNN_context* ctx, SpiNN_address address, char* host_destination, unsigned int device_address, unsigned int size, unsigned int staging_address, unsigned int staging_size)
+{
+	return spiNN_wait(ctx, spiNN_write_compressed_memory_async(ctx, address, host_destination, device_address, size, staging_address, staging_size, NULL, NULL));
+}
 
-	int offset = 0;
+spiNN_request spiNN_write_compressed_memory_async(spiNN_context* ctx, SpiNN_address address, char* host_destination, unsigned int device_address, unsigned int size, unsigned int staging_address, unsigned int staging_size, spiNN_completion_callback callback, void* user_data)
+{
+	spiNN_table* t;
+	unsigned int stream_size;
+
+	//only whole words can be expanded on the chip (by an application core)
+	if ((((device_address | size) & 3) != 0) || (address.core_id == 0))
+		return spiNN_writenonzero_memory_async(ctx, address, host_destination, device_address, size, callback, user_data);
+
+	//encode outside the lock and keep it only if it is cheaper than the sparse write (including the time to expand it)
+	t = spiNN_create_table(staging_address);
+	spiNN_table_data(t, host_destination, device_address, size);
+	stream_size = spiNN_table_size(t);
+	if ((stream_size > staging_size) || (table_cost(t) >= nonzero_cost(host_destination, size, device_address)))
+	{
+		spiNN_free_table(t);
+		return spiNN_writenonzero_memory_async(ctx, address, host_destination, device_address, size, callback, user_data);
+	}
 
+	return spiNN_run_table_async(ctx, address, t, callback, user_data);
+}
 
-	while (1){
-		//skip until non zero value
-		if (host_destination[offset] == 0){
-			offset++;
-			if (offset == size)
-				return SPINN_SUCCESS;
-			continue;
-		}
+int spiNN_poll(spiNN_context* ctx, int timeout_ms)
+{
+	int pending;
 
-		remaining = (size-offset);
-		len = (remaining > SDP_DATA_MAX)? SDP_DATA_MAX : remaining;
+	pthread_mutex_lock(&ctx->lock);
+	progress(ctx, timeout_ms);
+	pending = pending_requests(ctx);
+	pthread_mutex_unlock(&ctx->lock);
 
-		//check packet data and cut short if 0 value is found
-		for (i=offset; i<offset+len; i++){
-			if (host_destination[i] == 0){
-				len = i-offset;
-				break;
-			}
-		}
+	return pending;
+}
 
-		hdr.cmd = CMD_WRITE;
-		hdr.arg1 = device_address+offset;
-		hdr.arg2 = len;
-		hdr.arg3 = TYPE_BYTE;
+int spiNN_wait(spiNN_context* ctx, spiNN_request request)
+{
+	async_request* r;
+	int result;
 
-		//copy into packet data
-		memcpy(pkt_data, &host_destination[offset], len);
+	if (request == 0)
+		return SPINN_FAILURE;	//submission failed (error already raised)
 
-		if (!send_cmd(&hdr, pkt_data, len, &resp_hdr, resp_data))
-			return SPINN_FAILURE;
+	pthread_mutex_lock(&ctx->lock);
+	r = find_request(ctx, request);
+	if ((r != NULL) && (r->callback == NULL))
+	{
+		//another thread may run the event loop (or collect the completion) while the lock is released for epoll
+		while ((r->id == request) && (r->completion.status == SPINN_REQUEST_PENDING))
+			progress(ctx, -1);
+	}
 
-		offset += len;
-		if (offset == size)
-			return SPINN_SUCCESS;
+	if ((r == NULL) || (r->callback != NULL) || (r->id != request))
+	{
+		raise_error(ctx, SPINN_ERROR_REQUEST_HANDLE);
+		result = SPINN_FAILURE;
 	}
+	else
+		result = reap_request(ctx, r);
+	pthread_mutex_unlock(&ctx->lock);
 
-	//should never get here!
-	return SPINN_FAILURE;
+	return result;
 }
 
+int spiNN_get_completion(spiNN_context* ctx, spiNN_completion* completion)
+{
+	async_request* r;
+
+	pthread_mutex_lock(&ctx->lock);
+	r = next_completion(ctx, 0);
+	if (r != NULL)
+	{
+		memcpy(completion, &r->completion, sizeof(spiNN_completion));
+		r->id = 0;
+	}
+	pthread_mutex_unlock(&ctx->lock);
+
+	return (r != NULL)? SPINN_SUCCESS : SPINN_FAILURE;
+}
 
 
-int spiNN_send_SDP_message(SpiNN_address address, char virtual_port, char* message, unsigned int message_len)
+int spiNN_send_SDP_message(spiNN_context* ctx, SpiNN_address address, char virtual_port, char* message, unsigned int message_len)
 {
 	sdp_hdr hdr;
+	struct iovec iov[2];
+	struct msghdr msg;
 
-	if (check_SpiNN_address(&address) == SPINN_FAILURE)
+	if (check_SpiNN_address(ctx, &address) == SPINN_FAILURE)
 		return SPINN_FAILURE;
 
 	if ((virtual_port<1)||(virtual_port>7))
 	{
-		last_error = SPINN_ERROR_SDP_VIRTUAL_PORT_RANGE;
-		error_handler();
+		raise_error(ctx, SPINN_ERROR_SDP_VIRTUAL_PORT_RANGE);
 		return SPINN_FAILURE;
 	}
 
@@ -550,23 +1035,25 @@ int spiNN_send_SDP_message(SpiNN_address address, char virtual_port, char* messa
 	//send version query and get response
 	if (message_len>SDP_DATA_MAX)
 	{
-		last_error = SPINN_ERROR_SDP_DATA_SIZE;
-		error_handler();
+		raise_error(ctx, SPINN_ERROR_SDP_DATA_SIZE);
 		return SPINN_FAILURE;
 	}
 
-	//create the packet to be transmit (header plus the data part)
-	char* packet = (char*)malloc(SDP_HDR_SIZE+message_len);
-	memcpy(packet, &hdr, SDP_HDR_SIZE);
-	memcpy(&packet[SDP_HDR_SIZE], message, message_len);
+	//gather the header and message into a single packet
+	iov[0].iov_base = &hdr;
+	iov[0].iov_len = SDP_HDR_SIZE;
+	iov[1].iov_base = message;
+	iov[1].iov_len = message_len;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_name = &ctx->spiNN_addr;
+	msg.msg_namelen = sizeof(ctx->spiNN_addr);
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
 
-	int sent = sendto(spiNN_sock, packet, SDP_HDR_SIZE+message_len, 0, (struct sockaddr*)&spiNN_addr, sizeof(spiNN_addr));
-
-	free(packet);
+	int sent = sendmsg(ctx->spiNN_sock, &msg, 0);
 
 	if (sent<0){
-		last_error = SPINN_ERROR_SDP_SEND;
-		error_handler();
+		raise_error(ctx, SPINN_ERROR_SDP_SEND);
 		return SPINN_FAILURE;
 	}
 
@@ -574,53 +1061,52 @@ int spiNN_send_SDP_message(SpiNN_address address, char virtual_port, char* messa
 	return SPINN_SUCCESS;
 }
 
-int spiNN_receive_SDP_message(SpiNN_address* source, char* virtual_port, char* message, int message_len)
+int spiNN_receive_SDP_message(spiNN_context* ctx, SpiNN_address* source, char* virtual_port, char* message, int message_len)
 {
 	sdp_hdr resp_hdr;
-	struct sockaddr from;
-	unsigned int from_len;
+	struct iovec iov[2];
+	struct msghdr msg;
 	fd_set socks;
 	struct timeval t;
 
 
 	if (message_len>SDP_DATA_MAX)
 	{
-		last_error = SPINN_ERROR_SDP_DATA_SIZE;
-		error_handler();
+		raise_error(ctx, SPINN_ERROR_SDP_DATA_SIZE);
 		return SPINN_FAILURE;
 	}
 
 
 	memset(&resp_hdr, 0 , SDP_HDR_SIZE);
-	char* packet = (char*)malloc(SDP_HDR_SIZE+message_len);
-	from_len = sizeof(from);
 
 	//check for timeout
 	FD_ZERO(&socks);
-	FD_SET(spiNN_sock, &socks);
+	FD_SET(ctx->spiNN_sock, &socks);
 	t.tv_sec = TIMEOUT_SEC;
-	if (!select(spiNN_sock+1, &socks, NULL, NULL, &t))
+	t.tv_usec = 0;
+	if (!select(ctx->spiNN_sock+1, &socks, NULL, NULL, &t))
 	{
-		last_error = SPINN_ERROR_SDP_TIMEOUT;
-		error_handler();
+		raise_error(ctx, SPINN_ERROR_SDP_TIMEOUT);
 		return SPINN_FAILURE;
 	}
 
-	//receive packet
-	int received = recvfrom(spiNN_sock, packet, SDP_HDR_SIZE+message_len, 0, (struct sockaddr*)&from, &from_len);
+	//receive packet (scattered directly into the hdr and message)
+	iov[0].iov_base = &resp_hdr;
+	iov[0].iov_len = SDP_HDR_SIZE;
+	iov[1].iov_base = message;
+	iov[1].iov_len = message_len;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+
+	int received = recvmsg(ctx->spiNN_sock, &msg, 0);
 	if (received < 0){
-		last_error = SPINN_ERROR_SDP_RECEIVE;
-		error_handler();
+		raise_error(ctx, SPINN_ERROR_SDP_RECEIVE);
 		printf("an error: %s\n", strerror(errno));
 
 		return SPINN_FAILURE;
 	}
 
-	//copy into hdr and data
-	memcpy(&resp_hdr, packet, SDP_HDR_SIZE);
-	memcpy(message, &packet[SDP_HDR_SIZE], message_len);
-	free(packet);
-
 	//update from details and virtual port from
 	source->core_id = resp_hdr.src_core_id & 31;
 	source->x = resp_hdr.src_cpu>>8;
@@ -631,9 +1117,9 @@ int spiNN_receive_SDP_message(SpiNN_address* source, char* virtual_port, char* m
 }
 
 
-void spiNN_debug_message_callback(void (*receiveMessage)(SpiNN_address, char*))
+void spiNN_debug_message_callback(spiNN_context* ctx, void (*receiveMessage)(SpiNN_address, char*))
 {
-	debug_handler = receiveMessage;
+	ctx->debug_handler = receiveMessage;
 }
 
 void spiNN_handle_debug_message(SpiNN_address address, char* message)
@@ -650,19 +1136,41 @@ void spiNN_handle_debug_message(SpiNN_address address, char* message)
 
 
 
-void spiNN_set_error_callback(void (*error_callback)(void))
+void spiNN_get_transport_stats(spiNN_context* ctx, spiNN_transport_stats* stats)
+{
+	pthread_mutex_lock(&ctx->lock);
+	stats->rtt_us = ctx->cmd_pacer.srtt;
+	stats->rtt_var_us = ctx->cmd_pacer.rttvar;
+	stats->timeout_us = ctx->cmd_pacer.rto;
+	stats->window = ctx->cmd_pacer.cwnd;
+	stats->pace_us = ctx->cmd_pacer.interval;
+	stats->commands_sent = ctx->cmd_pacer.sent;
+	stats->responses = ctx->cmd_pacer.responses;
+	stats->timeouts = ctx->cmd_pacer.timeouts;
+	stats->retransmits = ctx->cmd_pacer.retransmits;
+	stats->duplicates = ctx->cmd_pacer.duplicates;
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+
+void spiNN_set_error_callback(spiNN_context* ctx, void (*error_callback)(spiNN_context*, spiNN_error))
 {
-	error_handler = error_callback;
+	ctx->error_handler = error_callback;
 }
 
 
-spiNN_error spiNN_get_error(){
-	return last_error;
+spiNN_error spiNN_get_error(spiNN_context* ctx){
+	spiNN_error error;
+
+	pthread_mutex_lock(&ctx->lock);
+	error = ctx->last_error;
+	pthread_mutex_unlock(&ctx->lock);
+	return error;
 }
 
 const char* spiNN_get_error_string(spiNN_error error)
 {
-	switch(last_error)
+	switch(error)
 	{
 	case(SPINN_NO_ERROR):
 			return "No Errors";
@@ -731,6 +1239,12 @@ const char* spiNN_get_error_string(spiNN_error error)
 	case(SPINN_ERROR_ADDRESS_CORE_ID):
 		return "SpiNN_address core_id value outside the range of [0-(MAX_CORES_PERCHIP-1)].";
 		break;
+	case(SPINN_ERROR_REQUEST_LIMIT):
+		return "Too many asynchronous requests outstanding (collect completions with spiNN_get_completion() or spiNN_wait()).";
+		break;
+	case(SPINN_ERROR_REQUEST_HANDLE):
+		return "Request handle is not outstanding or was submitted with a completion callback.";
+		break;
 	default:
 		return "No Error Description Found";
 		break;
@@ -738,10 +1252,18 @@ const char* spiNN_get_error_string(spiNN_error error)
 }
 
 
-void spiNN_print_error(void)
+void spiNN_print_error(spiNN_context* ctx, spiNN_error error)
 {
-	if (last_error != SPINN_NO_ERROR)
-		printf("ERROR(%i): %s\n", last_error, spiNN_get_error_string(last_error));
+	char ip[INET_ADDRSTRLEN];
+
+	if (error == SPINN_NO_ERROR)
+		return;
+
+	//name the board as every board of a machine has its own context
+	if ((ctx != NULL) && (inet_ntop(AF_INET, &ctx->spiNN_addr.sin_addr, ip, sizeof(ip)) != NULL))
+		printf("ERROR(%i) board %s: %s\n", error, ip, spiNN_get_error_string(error));
+	else
+		printf("ERROR(%i): %s\n", error, spiNN_get_error_string(error));
 }
 
 /* ------------------------------------------------------------------------------------------------
@@ -749,54 +1271,78 @@ void spiNN_print_error(void)
  * ------------------------------------------------------------------------------------------------
  */
 
-int check_SpiNN_address(SpiNN_address* address)
+void raise_error(spiNN_context* ctx, spiNN_error error)
+{
+	//the error is passed to the handler so that it does not depend on which thread raised the last error
+	pthread_mutex_lock(&ctx->lock);
+	ctx->last_error = error;
+	ctx->error_handler(ctx, error);
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+int check_SpiNN_address(spiNN_context* ctx, SpiNN_address* address)
 {
 	if (address->core_id > MAX_CORES_PER_CHIP)
 	{
-		last_error = SPINN_ERROR_ADDRESS_CORE_ID;
-		error_handler();
+		raise_error(ctx, SPINN_ERROR_ADDRESS_CORE_ID);
 		return SPINN_FAILURE;
 	}
 	else
 		return SPINN_SUCCESS;
 }
 
-int connect_sdp(char* device_ip, unsigned int port)
+int connect_sdp(spiNN_context* ctx, char* device_ip, unsigned int port)
 {
 	in_addr_t addr;
+	struct epoll_event event;
 
 	//create new UDP socket
-	spiNN_sock = socket(AF_INET, SOCK_DGRAM, 0);
-	if (spiNN_sock == -1){
-		last_error = SPINN_ERROR_CONNECTION_SOCKET_CREATION;
-		error_handler();
+	ctx->spiNN_sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (ctx->spiNN_sock == -1){
+		raise_error(ctx, SPINN_ERROR_CONNECTION_SOCKET_CREATION);
 		return SPINN_FAILURE;
 	}
 
 	addr = inet_addr(device_ip);
 	if (addr<0)
 	{
-		last_error = SPINN_ERROR_CONNECTION_SERVER_ADDRESS;
-		error_handler();
+		raise_error(ctx, SPINN_ERROR_CONNECTION_SERVER_ADDRESS);
 		return SPINN_FAILURE;
 	}
 	//set all struct values to 0
-	spiNN_addr.sin_family = AF_INET;
-	spiNN_addr.sin_addr.s_addr = addr;
-	spiNN_addr.sin_port = htons(port);		// network byte order
+	ctx->spiNN_addr.sin_family = AF_INET;
+	ctx->spiNN_addr.sin_addr.s_addr = addr;
+	ctx->spiNN_addr.sin_port = htons(port);		// network byte order
+
+	//event loop waits for responses on the command socket
+	ctx->event_fd = epoll_create1(0);
+	if (ctx->event_fd == -1){
+		raise_error(ctx, SPINN_ERROR_CONNECTION_SOCKET_CREATION);
+		return SPINN_FAILURE;
+	}
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.fd = ctx->spiNN_sock;
+	if (epoll_ctl(ctx->event_fd, EPOLL_CTL_ADD, ctx->spiNN_sock, &event) == -1){
+		raise_error(ctx, SPINN_ERROR_CONNECTION_SOCKET_CREATION);
+		return SPINN_FAILURE;
+	}
+
+	//start with a small window and grow towards what the board sustains
+	reset_cmds(ctx);
+	pace_init(&ctx->cmd_pacer, 0);
 
 	return SPINN_SUCCESS;
 }
 
-int connect_debug()
+int connect_debug(spiNN_context* ctx)
 {
 	struct sockaddr_in 		debug_addr;
 
 	//create new UDP socket
-	debug_sock = socket(AF_INET, SOCK_DGRAM, 0);
-	if (debug_sock == -1){
-		last_error = SPINN_ERROR_CONNECTION_DEBUG_SOCKET_CREATION;
-		error_handler();
+	ctx->debug_sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (ctx->debug_sock == -1){
+		raise_error(ctx, SPINN_ERROR_CONNECTION_DEBUG_SOCKET_CREATION);
 		return SPINN_FAILURE;
 	}
 
@@ -806,17 +1352,17 @@ int connect_debug()
 	debug_addr.sin_addr.s_addr = INADDR_ANY;
 	debug_addr.sin_port = htons(SPINNAKER_DEBUG_OUTPUT_PORT);		// network byte order
 
-	if (bind(debug_sock, (struct sockaddr*) &debug_addr, sizeof(debug_addr))  == -1){
-		last_error = SPINN_ERROR_CONNECTION_DEBUG_SOCKET_BIND;
-		error_handler();
+	if (bind(ctx->debug_sock, (struct sockaddr*) &debug_addr, sizeof(debug_addr))  == -1){
+		raise_error(ctx, SPINN_ERROR_CONNECTION_DEBUG_SOCKET_BIND);
 		return SPINN_FAILURE;
 	}
 
 	return SPINN_SUCCESS;
 }
 
-void* listen_debug(void* null)
+void* listen_debug(void* context)
 {
+	spiNN_context* ctx = (spiNN_context*)context;
 	char debug_buffer[SDP_DATA_MAX];
 	sdp_cmd_resp_hdr res;
 	SpiNN_address address;
@@ -828,9 +1374,8 @@ void* listen_debug(void* null)
 	while(1)
 	{
 		memset(debug_buffer, 0, SDP_DATA_MAX);
-		if (!recv(debug_sock, debug_buffer, SDP_DATA_MAX, 0)){
-			last_error = SPINN_ERROR_DEBUG_LISTENER_RECEIVE;
-			error_handler();
+		if (!recv(ctx->debug_sock, debug_buffer, SDP_DATA_MAX, 0)){
+			raise_error(ctx, SPINN_ERROR_DEBUG_LISTENER_RECEIVE);
 			return 0;
 		}
 		else
@@ -842,136 +1387,1466 @@ void* listen_debug(void* null)
 			address.core_id = res.src_core_id;
 
 			//send to handler
-			debug_handler(address, &debug_buffer[CMD_RESP_HDR_SIZE]);
+			ctx->debug_handler(address, &debug_buffer[CMD_RESP_HDR_SIZE]);
 		}
 	}
 	pthread_exit(NULL);
 	return NULL;
 }
 
-int send_cmd(sdp_hdr* hdr, const char* data, int data_length, sdp_cmd_resp_hdr* response, char* rsp_data)
+int send_cmd(spiNN_context* ctx, sdp_hdr* hdr, const char* data, int data_length, sdp_cmd_resp_hdr* response, char* rsp_data)
 {
-	//response
-	struct sockaddr from;
-	unsigned int from_len;
-	fd_set socks;
-	struct timeval t;
-	char* packet;
+	spiNN_request request;
 
-	//create the packet to be transmit (header plus the data part)
-	packet = (char*)malloc(SDP_HDR_SIZE+data_length);
+	pthread_mutex_lock(&ctx->lock);
+	request = submit_cmd_request(ctx, hdr, data, data_length, response, rsp_data, NULL, NULL);
+	pthread_mutex_unlock(&ctx->lock);
 
-	memcpy(packet, hdr, SDP_HDR_SIZE);
-	memcpy(&packet[SDP_HDR_SIZE], data, data_length);
+	return spiNN_wait(ctx, request);
+}
 
-	int sent = sendto(spiNN_sock, packet, SDP_HDR_SIZE+data_length, 0, (struct sockaddr*)&spiNN_addr, sizeof(spiNN_addr));
-	free(packet);
+spiNN_request submit_cmd_request(spiNN_context* ctx, sdp_hdr* hdr, const char* data, int data_length, sdp_cmd_resp_hdr* response, char* rsp_data, spiNN_completion_callback callback, void* user_data)
+{
+	async_request* r;
 
-	if (sent<0){
-		last_error = SPINN_ERROR_SDP_CMD_SEND;
-		error_handler();
-		return SPINN_FAILURE;
-	}
+	r = create_request(ctx, REQUEST_CMD, NULL, callback, user_data);
+	if (r == NULL)
+		return 0;
 
+	memcpy(&r->hdr, hdr, SDP_HDR_SIZE);
+	r->host = (char*)data;
+	r->data_length = data_length;
+	r->response = response;
+	r->rsp_data = rsp_data;
+	r->size = 1;	//a single command
 
-	//create the packet to hold response
-	packet = (char*)malloc(CMD_RESP_HDR_SIZE+SDP_DATA_MAX);
-	from_len = sizeof(from);
+	return submit_request(ctx, r);
+}
 
-	//check for timeout
-	FD_ZERO(&socks);
-	FD_SET(spiNN_sock, &socks);
-	t.tv_sec = TIMEOUT_SEC;
-	t.tv_usec = 0;
-	if (!select(spiNN_sock+1, &socks, NULL, NULL, &t))
+async_request* create_request(spiNN_context* ctx, request_type type, SpiNN_address* address, spiNN_completion_callback callback, void* user_data)
+{
+	async_request* r;
+	unsigned int i;
+
+	if ((address != NULL) && (check_SpiNN_address(ctx, address) == SPINN_FAILURE))
+		return NULL;
+
+	//find a free entry (completing outstanding requests if the table is full)
+	r = NULL;
+	while (r == NULL)
+	{
+		for (i=0; i<SPINNAKER_MAX_REQUESTS; i++)
+		{
+			if (ctx->requests[i].id == 0)
+			{
+				r = &ctx->requests[i];
+				break;
+			}
+		}
+		if (r != NULL)
+			break;
+
+		//table is full of completions which have not been collected
+		if (pending_requests(ctx) == 0)
+		{
+			raise_error(ctx, SPINN_ERROR_REQUEST_LIMIT);
+			return NULL;
+		}
+		progress(ctx, -1);
+	}
+
+	memset(r, 0, sizeof(async_request));
+	r->id = ctx->next_request_id++;
+	if (ctx->next_request_id <= 0)
+		ctx->next_request_id = 1;	//0 is never a valid handle
+	r->type = type;
+	if (address != NULL)
+		r->address = *address;
+	r->callback = callback;
+	r->completion.request = r->id;
+	r->completion.status = SPINN_REQUEST_PENDING;
+	r->completion.error = SPINN_NO_ERROR;
+	r->completion.user_data = user_data;
+
+	return r;
+}
+
+spiNN_request submit_request(spiNN_context* ctx, async_request* r)
+{
+	spiNN_request id;
+
+	//commands are issued into the window by the event loop (empty requests complete immediately)
+	id = r->id;
+	if (!next_chunk(r))
+		finish_request(ctx, r, SPINN_NO_ERROR);
+
+	return id;
+}
+
+async_request* find_request(spiNN_context* ctx, spiNN_request request)
+{
+	unsigned int i;
+
+	for (i=0; i<SPINNAKER_MAX_REQUESTS; i++)
+	{
+		if (ctx->requests[i].id == request)
+			return &ctx->requests[i];
+	}
+	return NULL;
+}
+
+unsigned int zero_bytes(const char* data, unsigned int length)
+{
+	unsigned int i;
+
+	i = 0;
+#if defined(__SSE2__)
+	//sixteen bytes at a time until a non zero byte is found
+	const __m128i zero = _mm_setzero_si128();
+	for (;i+16<=length;i+=16)
+	{
+		unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)&data[i]), zero));
+		if (mask != 0xFFFF)
+			return i + __builtin_ctz(~mask);
+	}
+#endif
+	for (;(i<length)&&(data[i]==0);i++);
+	return i;
+}
+
+unsigned int word_run(const char* data, unsigned int words, int zero)
+{
+	unsigned int i;
+	unsigned int w;
+
+	i = 0;
+#if defined(__SSE2__)
+	//one bit per word which is zero (four words at a time)
+	const __m128i z = _mm_setzero_si128();
+	const unsigned int run = zero ? 0xF : 0x0;
+	for (;i+4<=words;i+=4)
+	{
+		unsigned int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)&data[i*4]), z)));
+		if (mask != run)
+			return i + __builtin_ctz(mask ^ run);
+	}
+#endif
+	for (;i<words;i++)
+	{
+		memcpy(&w, &data[i*4], sizeof(unsigned int));
+		if ((w == 0) != (zero != 0))
+			break;
+	}
+	return i;
+}
+
+unsigned int plan_nonzero(const char* data, unsigned int length)
+{
+	unsigned int words;
+	unsigned int pos;
+	unsigned int end;
+	unsigned int gap;
+
+	//extend the packet over non zero words and any zero gaps which are cheaper to send than a new command
+	words = length / 4;
+	pos = 0;
+	end = 0;
+	while (pos < words)
+	{
+		pos += word_run(&data[pos*4], words-pos, 0);
+		end = pos;
+		gap = word_run(&data[pos*4], words-pos, 1);
+		if ((pos+gap >= words) || (gap*4 >= SPINNAKER_WRITE_MERGE_GAP))
+			break;
+		pos += gap;
+	}
+	return end * 4;
+}
+
+unsigned int nonzero_cost(char* data, unsigned int size, unsigned int device_address)
+{
+	async_request r;
+	unsigned int cost;
+	unsigned int len;
+
+	//plan the chunks exactly as the event loop would issue them
+	memset(&r, 0, sizeof(async_request));
+	r.type = REQUEST_WRITE_NONZERO;
+	r.host = data;
+	r.device_address = device_address;
+	r.size = size;
+	r.completion.status = SPINN_REQUEST_PENDING;
+	cost = 0;
+	while (next_chunk(&r))
+	{
+		len = chunk_length(&r);
+		assert(len > 0);
+		cost += len + SPINNAKER_WRITE_MERGE_GAP;
+		r.offset += len;
+	}
+	return cost;
+}
+
+unsigned int table_cost(spiNN_table* t)
+{
+	unsigned int size;
+
+	//stream packets, the command which runs the table and the time taken to expand it
+	size = spiNN_table_size(t);
+	return size + ((size+SDP_DATA_MAX-1)/SDP_DATA_MAX + 1)*SPINNAKER_WRITE_MERGE_GAP + table_expansion(t);
+}
+
+unsigned int table_expansion(spiNN_table* t)
+{
+	return t->expanded/SPINNAKER_APLX_SPEEDUP;
+}
+
+void schedule_polls(async_request* r, unsigned int run_time_us)
+{
+	//first poll once the table should have finished and then a few times per estimate if it overruns
+	r->poll_interval = (run_time_us/SPINNAKER_POLL_DIVISOR > SPINNAKER_POLL_MIN_INTERVAL)? run_time_us/SPINNAKER_POLL_DIVISOR : SPINNAKER_POLL_MIN_INTERVAL;
+	r->next_poll = (run_time_us > SPINNAKER_POLL_MIN_INTERVAL)? run_time_us : SPINNAKER_POLL_MIN_INTERVAL;	//from the run command
+}
+
+unsigned int equal_run(const char* data, unsigned int words)
+{
+	unsigned int i;
+
+	for (i=1;(i<words)&&(memcmp(&data[i*4], data, sizeof(unsigned int))==0);i++);
+	return i;
+}
+
+unsigned int fnv1a(const char* data, unsigned int size)
+{
+	unsigned int h;
+	unsigned int i;
+
+	h = 2166136261u;
+	for (i=0;i<size;i++)
+		h = (h ^ (unsigned char)data[i]) * 16777619u;
+	return h;
+}
+
+cached_file* map_file(char* filename)
+{
+	cached_file* file;
+	cached_file* other;
+	struct stat st;
+	unsigned int name_hash;
+	unsigned int bucket;
+	unsigned int i;
+	int fd;
+
+	name_hash = fnv1a(filename, strlen(filename));
+	bucket = name_hash >> (32 - SPINNAKER_FILE_CACHE_BITS);
+
+	pthread_mutex_lock(&program_file_cache.lock);
+	for (file = program_file_cache.buckets[bucket]; file != NULL; file = file->next)
+	{
+		if ((file->name_hash == name_hash) && (strcmp(file->name, filename) == 0))
+		{
+			pthread_mutex_unlock(&program_file_cache.lock);
+			return file;
+		}
+	}
+
+	//map the file (read only so pages are shared with the page cache and never copied)
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+	{
+		pthread_mutex_unlock(&program_file_cache.lock);
+		return NULL;
+	}
+	if ((fstat(fd, &st) < 0) || (!S_ISREG(st.st_mode)))
+	{
+		close(fd);
+		pthread_mutex_unlock(&program_file_cache.lock);
+		return NULL;
+	}
+	file = (cached_file*)calloc(1, sizeof(cached_file));
+	file->size = st.st_size;
+	if (file->size > 0)
+	{
+		file->data = (char*)mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (file->data == MAP_FAILED)
+		{
+			close(fd);
+			free(file);
+			pthread_mutex_unlock(&program_file_cache.lock);
+			return NULL;
+		}
+	}
+	close(fd);
+	file->name = strdup(filename);
+	file->name_hash = name_hash;
+	file->content_hash = fnv1a(file->data, file->size);
+
+	//files with the same contents (e.g. copies or links of a prototype) share one mapping
+	for (i=0; i<(1 << SPINNAKER_FILE_CACHE_BITS); i++)
+	{
+		for (other = program_file_cache.buckets[i]; other != NULL; other = other->next)
+		{
+			if ((other->content_hash == file->content_hash) && (other->size == file->size) && (other->data != file->data) &&
+				(memcmp(other->data, file->data, file->size) == 0))
+			{
+				munmap(file->data, file->size);
+				file->data = other->data;
+			}
+		}
+	}
+
+	file->next = program_file_cache.buckets[bucket];
+	program_file_cache.buckets[bucket] = file;
+	pthread_mutex_unlock(&program_file_cache.lock);
+
+	return file;
+}
+
+unsigned int block_hash(const char* data)
+{
+	unsigned int h;
+	unsigned int w;
+	unsigned int i;
+
+	h = 2166136261u;
+	for (i=0;i<SPINNAKER_BLOCK_WORDS;i++)
+	{
+		memcpy(&w, &data[i*4], sizeof(unsigned int));
+		h = (h ^ w) * 16777619u;
+	}
+	return h >> (32 - SPINNAKER_BLOCK_HASH_BITS);
+}
+
+unsigned int block_match(const char* data, unsigned int pos, unsigned int words, unsigned int* hashes, unsigned int* src)
+{
+	unsigned int h;
+	unsigned int len;
+
+	if (pos+SPINNAKER_BLOCK_WORDS > words)
+		return 0;
+
+	//hash table holds the position (plus one) of the earliest block which still matches (so repeated copies can double in length)
+	h = block_hash(&data[pos*4]);
+	len = 0;
+	if (hashes[h] != 0)
+	{
+		//extend the match while it does not overlap the data it copies
+		*src = hashes[h]-1;
+		for (;(pos+len<words)&&(*src+len<pos)&&(memcmp(&data[(*src+len)*4], &data[(pos+len)*4], sizeof(unsigned int))==0);len++);
+	}
+	if (len < SPINNAKER_BLOCK_WORDS)
+	{
+		hashes[h] = pos+1;
+		return 0;
+	}
+	return len;
+}
+
+void add_table_entry(spiNN_table* t, unsigned int op, unsigned int a1, unsigned int a2, unsigned int a3)
+{
+	//entries grow in powers of 2
+	if ((t->count & (t->count-1)) == 0)
+		t->entries = (aplx_entry*)realloc(t->entries, (t->count ? t->count*2 : 16) * sizeof(aplx_entry));
+	t->entries[t->count].op = op;
+	t->entries[t->count].a1 = a1;
+	t->entries[t->count].a2 = a2;
+	t->entries[t->count].a3 = a3;
+	t->count++;
+}
+
+void add_table_literals(spiNN_table* t, unsigned int device_address, const char* data, unsigned int size)
+{
+	//copy source is an offset into the literal data until the table is complete
+	if (t->literal_size + size > t->literal_capacity)
+	{
+		t->literal_capacity = (t->literal_size + size) * 2;
+		t->literals = (char*)realloc(t->literals, t->literal_capacity);
+	}
+	memcpy(&t->literals[t->literal_size], data, size);
+	add_table_entry(t, APLX_STAGED, device_address, t->literal_size, size);
+	t->literal_size += size;
+	t->expanded += size;
+}
+
+int next_chunk(async_request* r)
+{
+	unsigned int start;
+	unsigned int aligned;
+
+	if (r->completion.status != SPINN_REQUEST_PENDING)
+		return 0;
+
+	//skip until non zero value (from the start of its word if that has not been sent and the whole word is in the buffer,
+	//a partial word at the end is sent as bytes from the non zero value)
+	if (r->type == REQUEST_WRITE_NONZERO)
+	{
+		start = r->offset;
+		r->offset += zero_bytes(&r->host[r->offset], r->size - r->offset);
+		if (r->offset < r->size)
+		{
+			aligned = (r->device_address + r->offset) & 3;
+			if ((r->offset - start >= aligned) && (r->offset - aligned + 4 <= r->size))
+				r->offset -= aligned;
+		}
+	}
+
+	//the table is run once the data it expands has been acknowledged and then polled until it has finished
+	if ((r->type == REQUEST_WRITE_EXEC) && (r->offset >= r->size))
+	{
+		if (r->outstanding > 0)
+			return 0;
+		return ((!r->executed) || (r->done_word != APLX_DONE));
+	}
+
+	return (r->offset < r->size);
+}
+
+unsigned int chunk_length(async_request* r)
+{
+	unsigned int remaining;
+	unsigned int len;
+	unsigned int address;
+	unsigned int i;
+
+	remaining = r->size - r->offset;
+	len = (remaining > SDP_DATA_MAX)? SDP_DATA_MAX : remaining;
+	address = r->device_address+r->offset;
+
+	//plan whole words of the packet (unaligned edges are sent as bytes up to the next word or zero)
+	if (r->type == REQUEST_WRITE_NONZERO)
+	{
+		if (((address & 3) == 0) && (len >= 4))
+			len = plan_nonzero(&r->host[r->offset], len);
+		else
+		{
+			if (len > 4 - (address & 3))
+				len = 4 - (address & 3);
+			for (i=r->offset; i<r->offset+len; i++){
+				if (r->host[i] == 0){
+					len = i-r->offset;
+					break;
+				}
+			}
+		}
+	}
+
+	return len;
+}
+
+void issue_chunk(spiNN_context* ctx, async_request* r, cmd_slot* slot)
+{
+	unsigned short seq;
+	unsigned int len;
+	unsigned int address;
+
+	slot->request = r;
+	r->outstanding++;
+
+	if (r->type == REQUEST_CMD)
+	{
+		//copy header keeping the slot sequence number
+		seq = slot->hdr.seq;
+		memcpy(&slot->hdr, &r->hdr, SDP_HDR_SIZE);
+		slot->hdr.tto = 8;
+		slot->hdr.flags = 0x87;
+		slot->hdr.tag = 255;
+		slot->hdr.src_core_id = 255;
+		slot->hdr.seq = seq;
+
+		slot->data = r->host;
+		slot->data_length = r->data_length;
+		slot->response = r->response;
+		slot->rsp_data = r->rsp_data;
+		slot->rsp_length = SDP_DATA_MAX;
+		r->offset++;
+		submit_cmd(ctx, slot);
+		return;
+	}
+
+	if ((r->type == REQUEST_WRITE_EXEC) && (r->offset >= r->size))
+	{
+		slot->hdr.dst_cpu = (r->address.x << 8) + r->address.y;
+		if (!r->executed)
+		{
+			//run the table from the start of the data written
+			slot->hdr.dst_core_id = r->address.core_id;
+			slot->hdr.cmd = CMD_APLX;
+			slot->hdr.arg1 = r->exec_address;
+			slot->data = "";
+			slot->data_length = 0;
+			r->executed = 1;
+			r->next_poll += now_us();
+			r->deadline = r->next_poll + (unsigned long long)SPINNAKER_READY_TIMEOUT * 1000;	//timeout beyond the estimate
+			r->done_word = 0;	//not done until polled
+		}
+		else
+		{
+			//poll the first word of the table with the monitor (the core is busy running the table)
+			slot->hdr.dst_core_id = 0;
+			slot->hdr.cmd = CMD_READ;
+			slot->hdr.arg1 = r->exec_address;
+			slot->hdr.arg2 = sizeof(unsigned int);
+			slot->hdr.arg3 = TYPE_WORD;
+			slot->rsp_data = (char*)&r->done_word;
+			slot->rsp_length = sizeof(unsigned int);
+			r->next_poll = now_us() + r->poll_interval;
+		}
+		submit_cmd(ctx, slot);
+		return;
+	}
+
+	len = chunk_length(r);
+	assert(len > 0);
+	address = r->device_address+r->offset;
+
+	slot->hdr.dst_cpu = (r->address.x << 8) + r->address.y;
+	slot->hdr.dst_core_id = r->address.core_id;
+	slot->hdr.arg1 = address;
+	slot->hdr.arg2 = len;
+	slot->hdr.arg3 = ((address | len) & 3) ? TYPE_BYTE : TYPE_WORD;
+	if (r->type == REQUEST_READ)
+	{
+		slot->hdr.cmd = CMD_READ;
+		slot->rsp_data = &r->host[r->offset];
+		slot->rsp_length = len;
+	}
+	else
 	{
-		last_error = SPINN_ERROR_SDP_CMD_TIMEOUT;
-		error_handler();
-		free(packet);
+		slot->hdr.cmd = CMD_WRITE;
+		slot->data = &r->host[r->offset];
+		slot->data_length = len;
+	}
+
+	r->offset += len;
+	submit_cmd(ctx, slot);
+}
+
+void issue_cmds(spiNN_context* ctx)
+{
+	async_request* r;
+	cmd_slot* slot;
+	unsigned long long now;
+	unsigned int i;
+	int issued;
+
+	//requests take turns to issue a chunk so that transfers to different cores overlap
+	now = now_us();
+	ctx->poll_due = 0;
+	do
+	{
+		issued = 0;
+		for (i=0; i<SPINNAKER_MAX_REQUESTS; i++)
+		{
+			r = &ctx->requests[(ctx->request_cursor + i) % SPINNAKER_MAX_REQUESTS];
+			if ((r->id == 0) || (!next_chunk(r)))
+				continue;
+
+			//tables which do not finish in time fail rather than being polled forever
+			if ((r->type == REQUEST_WRITE_EXEC) && (r->executed) && (now > r->deadline))
+			{
+				fail_request(ctx, r, SPINN_ERROR_SDP_CMD_TIMEOUT);
+				continue;
+			}
+
+			//running tables are polled at intervals so that polls do not take the window from data writes
+			if ((r->type == REQUEST_WRITE_EXEC) && (r->executed) && (now < r->next_poll))
+			{
+				if ((ctx->poll_due == 0) || (r->next_poll < ctx->poll_due))
+					ctx->poll_due = r->next_poll;
+				continue;
+			}
+
+			slot = acquire_cmd(ctx);
+			if (slot == NULL)
+			{
+				//window is full so the next pass starts with this request
+				ctx->request_cursor = (ctx->request_cursor + i) % SPINNAKER_MAX_REQUESTS;
+				return;
+			}
+			issue_chunk(ctx, r, slot);
+			issued = 1;
+		}
+	} while (issued);
+}
+
+void finish_request(spiNN_context* ctx, async_request* r, spiNN_error error)
+{
+	if (r->completion.status != SPINN_REQUEST_PENDING)
+		return;
+
+	r->completion.status = (error == SPINN_NO_ERROR)? SPINN_REQUEST_COMPLETE : SPINN_REQUEST_FAILED;
+	r->completion.error = error;
+	r->completed = ctx->requests_completed++;
+
+	free(r->file_data);
+	r->file_data = NULL;
+}
+
+void fail_request(spiNN_context* ctx, async_request* r, spiNN_error error)
+{
+	unsigned int i;
+	unsigned int n;
+
+	//abandon every command of the request (late responses are discarded as duplicates)
+	for (i=0; i<SPINNAKER_CMD_WINDOW; i++)
+	{
+		if ((ctx->cmd_window[i].in_use) && (ctx->cmd_window[i].request == r))
+		{
+			ctx->cmd_window[i].in_use = 0;
+			ctx->cmd_in_flight--;
+		}
+	}
+	n = 0;
+	for (i=0; i<ctx->cmd_pending_count; i++)
+	{
+		if (ctx->cmd_pending[i]->request != r)
+			ctx->cmd_pending[n++] = ctx->cmd_pending[i];
+	}
+	ctx->cmd_pending_count = n;
+
+	r->outstanding = 0;
+	finish_request(ctx, r, error);
+}
+
+int reap_request(spiNN_context* ctx, async_request* r)
+{
+	spiNN_error error;
+
+	error = r->completion.error;
+	r->id = 0;
+
+	if (error != SPINN_NO_ERROR)
+	{
+		raise_error(ctx, error);
 		return SPINN_FAILURE;
 	}
+	return SPINN_SUCCESS;
+}
+
+async_request* next_completion(spiNN_context* ctx, int with_callback)
+{
+	async_request* r;
+	unsigned int i;
+
+	//completions are delivered in the order they occurred
+	r = NULL;
+	for (i=0; i<SPINNAKER_MAX_REQUESTS; i++)
+	{
+		if ((ctx->requests[i].id == 0) || (ctx->requests[i].completion.status == SPINN_REQUEST_PENDING))
+			continue;
+		if ((ctx->requests[i].callback != NULL) != with_callback)
+			continue;
+		if ((r == NULL) || ((int)(ctx->requests[i].completed - r->completed) < 0))
+			r = &ctx->requests[i];
+	}
+	return r;
+}
+
+int pending_requests(spiNN_context* ctx)
+{
+	unsigned int i;
+	int pending;
+
+	pending = 0;
+	for (i=0; i<SPINNAKER_MAX_REQUESTS; i++)
+	{
+		if ((ctx->requests[i].id != 0) && (ctx->requests[i].completion.status == SPINN_REQUEST_PENDING))
+			pending++;
+	}
+	return pending;
+}
+
+int deliver_completions(spiNN_context* ctx)
+{
+	async_request* r;
+	spiNN_completion completion;
+	spiNN_completion_callback callback;
+	int delivered;
+
+	//the entry is released before the callback so that it may submit further requests
+	delivered = 0;
+	while ((r = next_completion(ctx, 1)) != NULL)
+	{
+		memcpy(&completion, &r->completion, sizeof(spiNN_completion));
+		callback = r->callback;
+		r->id = 0;
+		callback(&completion);
+		delivered++;
+	}
+	return delivered;
+}
+
+int progress(spiNN_context* ctx, int timeout_ms)
+{
+	struct epoll_event event;
+	unsigned long long deadline;
+	unsigned long long now;
+	int wait_ms;
+	int ready;
+
+	//fill the window from the outstanding requests
+	issue_cmds(ctx);
+	if (ctx->cmd_pending_count > 0)
+		transmit_cmds(ctx);
+
+	//retransmit (or fail) any commands whose response is overdue
+	expire_cmds(ctx, &deadline);
+	if (ctx->cmd_pending_count > 0)
+		transmit_cmds(ctx);
+
+	//wait until a response arrives, the next command is overdue or due to be paced out, a table is due to be polled or the
+	//callers timeout expires
+	if ((ctx->cmd_pending_count > 0) && (ctx->cmd_pacer.next_send < deadline))
+		deadline = ctx->cmd_pacer.next_send;
+	if ((ctx->poll_due != 0) && ((ctx->cmd_in_flight == 0) || (ctx->poll_due < deadline)))
+		deadline = ctx->poll_due;
+	if ((ctx->cmd_in_flight > 0) || (ctx->poll_due != 0))
+	{
+		now = now_us();
+		wait_ms = (deadline > now)? (deadline - now + 999) / 1000 : 0;
+		if ((timeout_ms >= 0) && (timeout_ms < wait_ms))
+			wait_ms = timeout_ms;
+
+		//other threads may submit requests while this one waits
+		pthread_mutex_unlock(&ctx->lock);
+		ready = epoll_wait(ctx->event_fd, &event, 1, wait_ms);
+		pthread_mutex_lock(&ctx->lock);
+		if (ready > 0)
+			receive_cmd_responses(ctx);
+	}
+
+	return deliver_completions(ctx);
+}
+
+cmd_slot* acquire_cmd(spiNN_context* ctx)
+{
+	cmd_slot* slot;
+
+	//slot is selected by sequence number so that responses can be matched directly
+	slot = &ctx->cmd_window[ctx->cmd_seq % SPINNAKER_CMD_WINDOW];
+	if ((slot->in_use) || (ctx->cmd_in_flight >= ctx->cmd_pacer.cwnd))
+		return NULL;
+
+	//common hdr values
+	memset(&slot->hdr, 0, SDP_HDR_SIZE);
+	slot->hdr.tto = 8;
+	slot->hdr.flags = 0x87;
+	slot->hdr.tag = 255;
+	slot->hdr.src_core_id = 255;
+	slot->hdr.seq = ctx->cmd_seq++;
+	slot->retries = 0;
+	slot->queued = 0;
+
+	slot->request = NULL;
+	slot->data = slot->buffer;
+	slot->data_length = 0;
+	slot->response = NULL;
+	slot->rsp_data = NULL;
+	slot->rsp_length = 0;
+
+	return slot;
+}
+
+int submit_cmd(spiNN_context* ctx, cmd_slot* slot)
+{
+	//commands are transmitted in batches once the window is filled (as pacing allows)
+	slot->in_use = 1;
+	slot->queued = 1;
+	ctx->cmd_in_flight++;
+	ctx->cmd_pending[ctx->cmd_pending_count++] = slot;
+
+	return SPINN_SUCCESS;
+}
 
-	//receive packet
-	int received = recvfrom(spiNN_sock, packet, CMD_RESP_HDR_SIZE+SDP_DATA_MAX, 0, (struct sockaddr*)&from, &from_len);
+int transmit_cmds(spiNN_context* ctx)
+{
+	struct mmsghdr* msg;
+	cmd_slot* slot;
+	unsigned int i;
+	unsigned int n;
+	unsigned long long t;
+	int sent;
+
+	//only the commands whose pacing deadline has been reached are sent, the rest wait (in progress()) for the next deadline
+	n = pace_ready(&ctx->cmd_pacer, ctx->cmd_pending_count);
+	if (n == 0)
+		return SPINN_SUCCESS;
+
+	//gather the header and data part of each command in the sub-batch into a packet
+	for (i=0; i<n; i++)
+	{
+		slot = ctx->cmd_pending[i];
+		msg = &ctx->cmd_tx_msgs[i];
+		ctx->cmd_tx_iov[i][0].iov_base = &slot->hdr;
+		ctx->cmd_tx_iov[i][0].iov_len = SDP_HDR_SIZE;
+		ctx->cmd_tx_iov[i][1].iov_base = (void*)slot->data;
+		ctx->cmd_tx_iov[i][1].iov_len = slot->data_length;
+		memset(msg, 0, sizeof(struct mmsghdr));
+		msg->msg_hdr.msg_name = &ctx->spiNN_addr;
+		msg->msg_hdr.msg_namelen = sizeof(ctx->spiNN_addr);
+		msg->msg_hdr.msg_iov = ctx->cmd_tx_iov[i];
+		msg->msg_hdr.msg_iovlen = 2;
+	}
+
+	//send the sub-batch (a single system call unless the socket buffer fills)
+	t = now_us();
+	i = 0;
+	while (i < n)
+	{
+		sent = sendmmsg(ctx->spiNN_sock, &ctx->cmd_tx_msgs[i], n-i, 0);
+		if (sent<=0){
+			//fail every request with a command in the batch
+			while (ctx->cmd_pending_count > 0)
+				fail_request(ctx, ctx->cmd_pending[0]->request, SPINN_ERROR_SDP_CMD_SEND);
+			return SPINN_FAILURE;
+		}
+		i += sent;
+	}
+
+	for (i=0; i<n; i++)
+	{
+		ctx->cmd_pending[i]->sent_time = t;
+		ctx->cmd_pending[i]->queued = 0;
+	}
+	ctx->cmd_pending_count -= n;
+	memmove(&ctx->cmd_pending[0], &ctx->cmd_pending[n], ctx->cmd_pending_count*sizeof(cmd_slot*));
+
+	return SPINN_SUCCESS;
+}
+
+void unqueue_cmd(spiNN_context* ctx, cmd_slot* slot)
+{
+	unsigned int i;
+	unsigned int n;
+
+	n = 0;
+	for (i=0; i<ctx->cmd_pending_count; i++)
+	{
+		if (ctx->cmd_pending[i] != slot)
+			ctx->cmd_pending[n++] = ctx->cmd_pending[i];
+	}
+	ctx->cmd_pending_count = n;
+	slot->queued = 0;
+}
+
+int receive_cmd_responses(spiNN_context* ctx)
+{
+	struct mmsghdr* msg;
+	cmd_slot* expected;
+	unsigned short seq;
+	unsigned int n;
+	unsigned int i;
+	unsigned int count;
+	int received;
+
+	//responses normally arrive in order so the data of each response in the batch is scattered straight into the
+	//destination of the next oldest command
+	expected = oldest_cmd(ctx);
+	seq = ctx->cmd_ack_seq;
+	for (n=0; n<ctx->cmd_in_flight; n++)
+	{
+		msg = &ctx->cmd_rx_msgs[n];
+		memset(msg, 0, sizeof(struct mmsghdr));
+		msg->msg_hdr.msg_iov = ctx->cmd_rx_iov[n];
+		ctx->cmd_rx_iov[n][0].iov_base = &ctx->cmd_rx_hdr[n];
+		ctx->cmd_rx_iov[n][0].iov_len = CMD_RESP_HDR_SIZE;
+		msg->msg_hdr.msg_iovlen = 1;
+		if ((expected != NULL) && (expected->rsp_data != NULL))
+		{
+			ctx->cmd_rx_iov[n][1].iov_base = expected->rsp_data;
+			ctx->cmd_rx_iov[n][1].iov_len = expected->rsp_length;
+			msg->msg_hdr.msg_iovlen++;
+		}
+		ctx->cmd_rx_iov[n][msg->msg_hdr.msg_iovlen].iov_base = ctx->cmd_rx_buffer[n];
+		ctx->cmd_rx_iov[n][msg->msg_hdr.msg_iovlen].iov_len = SDP_DATA_MAX;
+		msg->msg_hdr.msg_iovlen++;
+
+		//find the next command awaiting a response
+		expected = NULL;
+		while ((expected == NULL) && (seq != ctx->cmd_seq))
+		{
+			seq++;
+			if ((ctx->cmd_window[seq % SPINNAKER_CMD_WINDOW].in_use) && (ctx->cmd_window[seq % SPINNAKER_CMD_WINDOW].hdr.seq == seq))
+				expected = &ctx->cmd_window[seq % SPINNAKER_CMD_WINDOW];
+		}
+	}
+
+	//receive every response which is ready (the event loop has already waited for the first)
+	received = recvmmsg(ctx->spiNN_sock, ctx->cmd_rx_msgs, n, MSG_DONTWAIT, NULL);
 	if (received < 0){
-		last_error = SPINN_ERROR_SDP_CMD_RECEIVE;
-		error_handler();
-		//printf("an error: %s\n", strerror(errno));
-		free(packet);
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+			return SPINN_SUCCESS;
+
+		//fail every request awaiting a response
+		for (i=0; i<SPINNAKER_CMD_WINDOW; i++)
+		{
+			if (ctx->cmd_window[i].in_use)
+				fail_request(ctx, ctx->cmd_window[i].request, SPINN_ERROR_SDP_CMD_RECEIVE);
+		}
 		return SPINN_FAILURE;
 	}
 
-	//copy into rsp_hdr and rsp_data
-	memcpy(response, packet, CMD_RESP_HDR_SIZE);
-	memcpy(rsp_data, &packet[CMD_RESP_HDR_SIZE], received - CMD_RESP_HDR_SIZE);
-	free(packet);
+	//gather out of order data before any destination in the batch is rewritten
+	count = (unsigned int)received;
+	for (i=0; i<count; i++)
+		gather_cmd_response(ctx, i, ctx->cmd_rx_msgs[i].msg_len);
+	for (i=0; i<count; i++)
+		retire_cmd(ctx, i, ctx->cmd_rx_msgs[i].msg_len);
+
+	return SPINN_SUCCESS;
+}
+
+cmd_slot* match_cmd(spiNN_context* ctx, unsigned int m, unsigned int received)
+{
+	sdp_cmd_resp_hdr* response;
+	cmd_slot* slot;
+
+	if (received < CMD_RESP_HDR_SIZE)
+		return NULL;	//runt packet (ignore)
+
+	//match the response to its command by sequence number
+	response = &ctx->cmd_rx_hdr[m];
+	slot = &ctx->cmd_window[response->seq % SPINNAKER_CMD_WINDOW];
+	if ((!slot->in_use) || (slot->hdr.seq != response->seq))
+		return NULL;	//duplicate (or late) response to a completed or abandoned command (ignore)
+
+	return slot;
+}
+
+void gather_cmd_response(spiNN_context* ctx, unsigned int m, unsigned int received)
+{
+	struct iovec* iov;
+	cmd_slot* slot;
+	size_t len;
+
+	ctx->cmd_rx_data[m] = NULL;
+	slot = match_cmd(ctx, m, received);
+	if ((slot == NULL) || (slot->rsp_data == NULL))
+		return;
+
+	iov = ctx->cmd_rx_iov[m];
+	if (ctx->cmd_rx_msgs[m].msg_hdr.msg_iovlen == 2)
+	{
+		//no expected destination so all data is in the receive buffer
+		ctx->cmd_rx_data[m] = ctx->cmd_rx_buffer[m];
+	}
+	else if (iov[1].iov_base != slot->rsp_data)
+	{
+		//data was scattered into another command's destination (which is rewritten by its own response) so gather it
+		len = received - CMD_RESP_HDR_SIZE;
+		if (len > iov[1].iov_len)
+		{
+			memmove(&ctx->cmd_rx_buffer[m][iov[1].iov_len], ctx->cmd_rx_buffer[m], len - iov[1].iov_len);
+			len = iov[1].iov_len;
+		}
+		memcpy(ctx->cmd_rx_buffer[m], iov[1].iov_base, len);
+		ctx->cmd_rx_data[m] = ctx->cmd_rx_buffer[m];
+	}
+}
 
-	//sleep wait
-	usleep(SPINNAKER_CMD_DELAY);
+void retire_cmd(spiNN_context* ctx, unsigned int m, unsigned int received)
+{
+	async_request* r;
+	cmd_slot* slot;
+	unsigned int len;
+
+	slot = match_cmd(ctx, m, received);
+	if (slot == NULL)
+	{
+		if (received >= CMD_RESP_HDR_SIZE)
+			ctx->cmd_pacer.duplicates++;
+		return;
+	}
+
+	//copy out of order data to its destination
+	if (ctx->cmd_rx_data[m] != NULL)
+	{
+		len = received - CMD_RESP_HDR_SIZE;
+		if (len > (unsigned int)slot->rsp_length)
+			len = slot->rsp_length;
+		memcpy(slot->rsp_data, ctx->cmd_rx_data[m], len);
+	}
+
+	//copy response hdr
+	if (slot->response != NULL)
+		memcpy(slot->response, &ctx->cmd_rx_hdr[m], CMD_RESP_HDR_SIZE);
+
+	//a late response may arrive while the command is waiting to be sent again
+	if (slot->queued)
+		unqueue_cmd(ctx, slot);
+
+	//retransmitted commands give an ambiguous rtt sample (Karn's algorithm)
+	pace_response(&ctx->cmd_pacer, now_us() - slot->sent_time, slot->retries == 0);
+	slot->in_use = 0;
+	ctx->cmd_in_flight--;
+
+	//the request is complete once every chunk has been issued and acknowledged
+	r = slot->request;
+	r->outstanding--;
+	if ((r->outstanding == 0) && (!next_chunk(r)))
+		finish_request(ctx, r, SPINN_NO_ERROR);
+}
+
+int expire_cmds(spiNN_context* ctx, unsigned long long* next_deadline)
+{
+	cmd_slot* slot;
+	unsigned long long now;
+	unsigned long long deadline;
+	unsigned long long timeout;
+	unsigned int i;
+	int lost;
+
+	now = now_us();
+	lost = 0;
+	*next_deadline = now + PACE_MAX_RTO;
+
+	for (i=0; i<SPINNAKER_CMD_WINDOW; i++)
+	{
+		slot = &ctx->cmd_window[i];
+		if ((!slot->in_use) || (slot->queued))
+			continue;
+
+		//idempotent commands use the rtt derived timeout (doubled for each retry), others the full timeout
+		timeout = PACE_MAX_RTO;
+		if (is_idempotent(slot->hdr.cmd))
+		{
+			timeout = (unsigned long long)ctx->cmd_pacer.rto << slot->retries;
+			if (timeout > PACE_MAX_RTO)
+				timeout = PACE_MAX_RTO;
+		}
+		deadline = slot->sent_time + timeout;
+
+		if (deadline > now)
+		{
+			if (deadline < *next_deadline)
+				*next_deadline = deadline;
+			continue;
+		}
+
+		//response is overdue so send again (with the same seq) or give up on the request
+		lost = 1;
+		if ((!is_idempotent(slot->hdr.cmd)) || (slot->retries >= SPINNAKER_CMD_RETRIES))
+		{
+			fail_request(ctx, slot->request, SPINN_ERROR_SDP_CMD_TIMEOUT);
+			continue;
+		}
+		slot->retries++;
+		slot->queued = 1;
+		ctx->cmd_pacer.retransmits++;
+		ctx->cmd_pending[ctx->cmd_pending_count++] = slot;
+	}
+
+	//back off once for each loss event (not for each command in the window)
+	if (lost)
+		pace_loss(&ctx->cmd_pacer);
 
 	return SPINN_SUCCESS;
 }
 
+int is_idempotent(unsigned short cmd)
+{
+	return ((cmd == CMD_READ) || (cmd == CMD_WRITE) || (cmd == CMD_SVER));
+}
+
+void reset_cmds(spiNN_context* ctx)
+{
+	unsigned int i;
+
+	for (i=0; i<SPINNAKER_CMD_WINDOW; i++)
+		ctx->cmd_window[i].in_use = 0;
+	ctx->cmd_in_flight = 0;
+	ctx->cmd_pending_count = 0;
+	ctx->cmd_ack_seq = ctx->cmd_seq;
+}
+
+cmd_slot* oldest_cmd(spiNN_context* ctx)
+{
+	cmd_slot* slot;
+
+	//nothing older than a full window can be awaiting a response
+	if ((unsigned short)(ctx->cmd_seq - ctx->cmd_ack_seq) > SPINNAKER_CMD_WINDOW)
+		ctx->cmd_ack_seq = ctx->cmd_seq - SPINNAKER_CMD_WINDOW;
+
+	while (ctx->cmd_ack_seq != ctx->cmd_seq)
+	{
+		slot = &ctx->cmd_window[ctx->cmd_ack_seq % SPINNAKER_CMD_WINDOW];
+		if ((slot->in_use) && (slot->hdr.seq == ctx->cmd_ack_seq))
+			return slot;
+		ctx->cmd_ack_seq++;
+	}
+	return NULL;
+}
+
+unsigned long long now_us()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((unsigned long long)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+void pace_init(pacer* p, unsigned int interval)
+{
+	memset(p, 0, sizeof(pacer));
+	p->srtt = PACE_INITIAL_RTT;
+	p->rttvar = PACE_INITIAL_RTT/2;
+	p->rto = PACE_MAX_RTO;
+	p->cwnd = PACE_INITIAL_CWND;
+	p->ssthresh = SPINNAKER_CMD_WINDOW;
+	p->interval = interval;
+}
+
+void pace_wait(pacer* p, unsigned int packets)
+{
+	unsigned long long t;
+
+	//only sleep for what remains of the gap since the last packets (blocks, so never called with the context locked)
+	t = now_us();
+	if (t < p->next_send)
+	{
+		usleep(p->next_send - t);
+		t = p->next_send;
+	}
+	p->next_send = t + (p->interval * packets);
+	p->sent += packets;
+}
+
+unsigned int pace_ready(pacer* p, unsigned int packets)
+{
+	unsigned long long t;
+	unsigned int n;
+
+	//no credit is saved up while idle
+	t = now_us();
+	if (p->next_send < t)
+		p->next_send = t;
+
+	//packets due within the resolution of the wait are sent together, the rest wait for their own deadline
+	if (p->interval == 0)
+		n = packets;
+	else if (p->next_send > t + PACE_SLACK)
+		n = 0;
+	else
+	{
+		n = (t + PACE_SLACK - p->next_send) / p->interval + 1;
+		if (n > packets)
+			n = packets;
+	}
+	p->next_send += (unsigned long long)p->interval * n;
+	p->sent += n;
+
+	return n;
+}
+
+void pace_response(pacer* p, unsigned int rtt, int rtt_valid)
+{
+	unsigned int err;
+
+	p->responses++;
+
+	//rtt estimate and timeout (as RFC 6298)
+	if (rtt_valid){
+		p->rtt_samples++;
+		if (p->rtt_samples == 1){
+			p->srtt = rtt;
+			p->rttvar = rtt/2;
+		}else{
+			err = (rtt > p->srtt)? rtt - p->srtt : p->srtt - rtt;
+			p->rttvar = (3*p->rttvar + err)/4;
+			p->srtt = (7*p->srtt + rtt)/8;
+		}
+		p->rto = p->srtt + 4*p->rttvar;
+		if (p->rto < PACE_MIN_RTO)
+			p->rto = PACE_MIN_RTO;
+		if (p->rto > PACE_MAX_RTO)
+			p->rto = PACE_MAX_RTO;
+	}
+
+	//additive increase (slow start below threshold)
+	if (p->cwnd < p->ssthresh)
+		p->cwnd++;
+	else if (++p->cwnd_acks >= p->cwnd){
+		p->cwnd_acks = 0;
+		p->cwnd++;
+	}
+	if (p->cwnd > SPINNAKER_CMD_WINDOW)
+		p->cwnd = SPINNAKER_CMD_WINDOW;
+
+	//spread a window of packets over one round trip
+	p->interval = p->srtt / p->cwnd;
+}
+
+void pace_loss(pacer* p)
+{
+	p->timeouts++;
+
+	//multiplicative decrease
+	p->ssthresh = p->cwnd/2;
+	if (p->ssthresh < 1)
+		p->ssthresh = 1;
+	p->cwnd = p->ssthresh;
+	p->cwnd_acks = 0;
+
+	//back off the timeout and the packet gap
+	p->rto *= 2;
+	if (p->rto > PACE_MAX_RTO)
+		p->rto = PACE_MAX_RTO;
+	p->interval = p->srtt / p->cwnd;
+}
+
+
+int probe_version(spiNN_context* ctx, SpiNN_chip_address chip, int timeout_ms, sver* ver)
+{
+	sdp_hdr hdr;
+	sdp_cmd_resp_hdr resp_hdr;
+	char resp_data[SDP_DATA_MAX];
+	spiNN_request request;
+	async_request* r;
+	unsigned long long deadline;
+	unsigned long long now;
+	int result;
+
+	memset(&hdr, 0, SDP_HDR_SIZE);
+	hdr.dst_cpu = (chip.x << 8) + chip.y;
+	hdr.cmd = CMD_SVER;
+
+	pthread_mutex_lock(&ctx->lock);
+	request = submit_cmd_request(ctx, &hdr, "", 0, &resp_hdr, resp_data, NULL, NULL);
+	r = find_request(ctx, request);
+	result = SPINN_FAILURE;
+	if (r != NULL)
+	{
+		//run the event loop until the response arrives or the (short) probe timeout expires
+		deadline = now_us() + (unsigned long long)timeout_ms * 1000;
+		now = now_us();
+		while ((r->id == request) && (r->completion.status == SPINN_REQUEST_PENDING) && (now < deadline))
+		{
+			progress(ctx, (deadline - now + 999) / 1000);
+			now = now_us();
+		}
+
+		//no response is not an error (the board may not be booted) so the request is released without raising it
+		if (r->id == request)
+		{
+			if (r->completion.status == SPINN_REQUEST_PENDING)
+				fail_request(ctx, r, SPINN_ERROR_SDP_CMD_TIMEOUT);
+			else if (r->completion.error == SPINN_NO_ERROR)
+				result = SPINN_SUCCESS;
+			r->id = 0;
+		}
+	}
+	pthread_mutex_unlock(&ctx->lock);
+
+	if (result == SPINN_SUCCESS)
+		memcpy(ver, resp_data, SVER_SIZE);
+	return result;
+}
+
+int wait_for_version(spiNN_context* ctx, SpiNN_chip_address chip, int timeout_ms)
+{
+	unsigned long long deadline;
+	sver ver;
+
+	//probe until the chip answers rather than sleeping for a fixed time
+	deadline = now_us() + (unsigned long long)timeout_ms * 1000;
+	while (!probe_version(ctx, chip, SPINNAKER_PROBE_TIMEOUT, &ver))
+	{
+		if (now_us() >= deadline)
+			return SPINN_FAILURE;
+	}
+	return SPINN_SUCCESS;
+}
 
 //************************************************************************************************************
 
-int send_boot_pkt(unsigned int boot_sock, struct sockaddr_in *boot_addr, boot_hdr* hdr, const char* data, int data_length)
+void bswap_words(unsigned int* dst, const unsigned int* src, unsigned int words)
 {
-	char* packet;
-	int i;
+	unsigned int i;
+
+	i = 0;
+#if defined(__SSSE3__)
+	//reverse the bytes of four words at a time with a single shuffle
+	const __m128i order = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+	for (;i+4<=words;i+=4)
+		_mm_storeu_si128((__m128i*)&dst[i], _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&src[i]), order));
+#elif defined(__SSE2__)
+	//swap the bytes of each half word then the half words of each word
+	__m128i x;
+	for (;i+4<=words;i+=4)
+	{
+		x = _mm_loadu_si128((const __m128i*)&src[i]);
+		x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+		x = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xB1), 0xB1);
+		_mm_storeu_si128((__m128i*)&dst[i], x);
+	}
+#endif
+	//remaining words (or all words without SIMD support)
+	for (;i<words;i++)
+		dst[i] = ntohl(src[i]);
+}
+
+int load_boot_image(spiNN_context* ctx)
+{
+	int fd;
+	struct stat st;
+	const char* image;
+	unsigned int size;
+	unsigned int block_size;
+	unsigned int i;
+	boot_packet* p;
+	unsigned int tail[SPINNAKER_BOOT_DATA_MAX/4];
+	int result;
+
+	//the image is built once and then shared (read only) by every board which is booted
+	pthread_mutex_lock(&boot_image_cache.lock);
+	result = SPINN_SUCCESS;
+	if (boot_image_cache.packets)
+	{
+		pthread_mutex_unlock(&boot_image_cache.lock);
+		return result;
+	}
+
+	//map file
+	fd = open(SPINNAKER_BOOT_FILE, O_RDONLY);
+	if (fd < 0)
+	{
+		pthread_mutex_unlock(&boot_image_cache.lock);
+		raise_error(ctx, SPINN_ERROR_BOOT_FILE_NOT_FOUND);
+		return SPINN_FAILURE;
+	}
+	if ((fstat(fd, &st) < 0)||(st.st_size <= 0))
+	{
+		close(fd);
+		pthread_mutex_unlock(&boot_image_cache.lock);
+		raise_error(ctx, SPINN_ERROR_BOOT_FILE_READING);
+		return SPINN_FAILURE;
+	}
+	size = st.st_size;
+	if (size>SPINNAKER_MAX_BOOT_SIZE)
+	{
+		close(fd);
+		pthread_mutex_unlock(&boot_image_cache.lock);
+		raise_error(ctx, SPINN_ERROR_BOOT_FILE_TOO_LARGE);
+		return SPINN_FAILURE;
+	}
+	image = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (image == MAP_FAILED)
+	{
+		pthread_mutex_unlock(&boot_image_cache.lock);
+		raise_error(ctx, SPINN_ERROR_BOOT_FILE_READING);
+		return SPINN_FAILURE;
+	}
 
-	//create the packet to be transmit (header plus the data part)
-	packet = (char*)malloc(BOOT_HDR_SIZE+data_length);
-	memcpy(packet, hdr, BOOT_HDR_SIZE);
-	for (i=0;i<data_length;i+=sizeof(unsigned long int))	//big endian format
+	//build the data packets (headers and big endian data) ready to send
+	boot_image_cache.blocks = (size + SPINNAKER_BOOT_DATA_MAX - 1) / SPINNAKER_BOOT_DATA_MAX;
+	boot_image_cache.packets = (boot_packet*)malloc(boot_image_cache.blocks * sizeof(boot_packet));
+	for(i=0;i<boot_image_cache.blocks;i++)
 	{
-		unsigned long int l = *((unsigned int long*)&data[i]);
-		l = ntohl(l);
-		memcpy(&packet[BOOT_HDR_SIZE+i], &l, sizeof(unsigned long int));
+		p = &boot_image_cache.packets[i];
+		p->hdr.prot_ver = htons(1);
+		p->hdr.op = htonl(SPINNAKER_BOOT_CMD_DATA);
+		p->hdr.a1 = htonl((((SPINNAKER_BOOT_DATA_MAX/4)-1)<<8)|((i)&255));
+		p->hdr.a2 = 0;
+		p->hdr.a3 = 0;
+
+		block_size = size - (i*SPINNAKER_BOOT_DATA_MAX);
+		if (block_size >= SPINNAKER_BOOT_DATA_MAX)
+		{
+			block_size = SPINNAKER_BOOT_DATA_MAX;
+			bswap_words(p->data, (const unsigned int*)&image[i*SPINNAKER_BOOT_DATA_MAX], block_size/4);
+		}
+		else
+		{
+			//last block is padded with zeros to a whole number of words
+			memset(tail, 0, sizeof(tail));
+			memcpy(tail, &image[i*SPINNAKER_BOOT_DATA_MAX], block_size);
+			block_size = (block_size + 3) & ~3;
+			bswap_words(p->data, tail, block_size/4);
+		}
+		p->length = BOOT_HDR_SIZE + block_size;
 	}
+	munmap((void*)image, size);
 
+	boot_image_cache.gap = SPINNAKER_BOOT_MIN_GAP;
+	pthread_mutex_unlock(&boot_image_cache.lock);
+
+	return result;
+}
 
-	int sent = sendto(boot_sock, packet, BOOT_HDR_SIZE+data_length, 0, (struct sockaddr*)boot_addr, sizeof(*boot_addr));
-	free(packet);
+int send_boot_pkt(spiNN_context* ctx, unsigned int boot_sock, struct sockaddr_in *boot_addr, const void* pkt, int length)
+{
+	//boot packets are not acknowledged so are paced at the boot rom rate
+	pace_wait(&ctx->boot_pacer, 1);
+	int sent = sendto(boot_sock, pkt, length, 0, (struct sockaddr*)boot_addr, sizeof(*boot_addr));
 
 	if (sent<0){
-		last_error = SPINN_ERROR_BOOT_PKT_SEND;
-		error_handler();
+		raise_error(ctx, SPINN_ERROR_BOOT_PKT_SEND);
 		return SPINN_FAILURE;
 	}
 
-	//sleep wait
-	usleep(SPINNAKER_CMD_DELAY);
+	return SPINN_SUCCESS;
+}
+
+int send_boot_image(spiNN_context* ctx, unsigned int boot_sock, struct sockaddr_in *boot_addr)
+{
+	boot_hdr hdr;
+	unsigned int i;
+
+	//send start
+	hdr.prot_ver = htons(1);
+	hdr.op = htonl(SPINNAKER_BOOT_CMD_START);
+	hdr.a1 = 0;
+	hdr.a2 = 0;
+	hdr.a3 = htonl(boot_image_cache.blocks-1);
+	if (!send_boot_pkt(ctx, boot_sock, boot_addr, &hdr, BOOT_HDR_SIZE))
+		return SPINN_FAILURE;
+
+	//send prebuilt data blocks
+	for(i=0;i<boot_image_cache.blocks;i++)
+	{
+		if (!send_boot_pkt(ctx, boot_sock, boot_addr, &boot_image_cache.packets[i], boot_image_cache.packets[i].length))
+			return SPINN_FAILURE;
+	}
+
+	//send end
+	hdr.op = htonl(SPINNAKER_BOOT_CMD_END);
+	hdr.a1 = htonl(1);
+	hdr.a2 = 0;
+	hdr.a3 = 0;
+	if (!send_boot_pkt(ctx, boot_sock, boot_addr, &hdr, BOOT_HDR_SIZE))
+		return SPINN_FAILURE;
+
+	//wait for the final packet gap
+	pace_wait(&ctx->boot_pacer, 1);
 
 	return SPINN_SUCCESS;
 }
 
-int boot(char* device_ip)
+int boot(spiNN_context* ctx, char* device_ip)
 {
 	unsigned int boot_sock;
-	unsigned int n;
 	struct sockaddr_in boot_addr;
 	in_addr_t addr;
-	boot_hdr hdr;
-	char boot_buffer[SPINNAKER_BOOT_DATA_MAX];
-	FILE *boot_file;
-	unsigned int blocks;
-	unsigned int i;
+	SpiNN_chip_address origin;
+	unsigned int gap;
+	int ready;
 
 
+	if (!load_boot_image(ctx))
+		return SPINN_FAILURE;
+
 	//create new UDP socket
 	boot_sock = socket(AF_INET, SOCK_DGRAM, 0);
 	if (boot_sock == -1){
-		last_error = SPINN_ERROR_BOOT_SOCKET_CREATION;
-		error_handler();
+		raise_error(ctx, SPINN_ERROR_BOOT_SOCKET_CREATION);
 		return SPINN_FAILURE;
 	}
 
 	addr = inet_addr(device_ip);
 	if (addr<0)
 	{
-		last_error = SPINN_ERROR_CONNECTION_SERVER_ADDRESS;
-		error_handler();
+		raise_error(ctx, SPINN_ERROR_CONNECTION_SERVER_ADDRESS);
 		return SPINN_FAILURE;
 	}
 	//set all struct values to 0
@@ -979,69 +2854,37 @@ int boot(char* device_ip)
 	boot_addr.sin_addr.s_addr = addr;
 	boot_addr.sin_port = htons(SPINNAKER_BOOT_PORT);		// network byte order
 
-	//open file
-	if(!(boot_file = fopen(SPINNAKER_BOOT_FILE, "r")))
+	origin.x = 0;
+	origin.y = 0;
+	do
 	{
-		last_error = SPINN_ERROR_BOOT_FILE_NOT_FOUND;
-		error_handler();
-		return SPINN_FAILURE;
-	}
-
-	//check size
-	fseek(boot_file, 0, SEEK_END);
-	n = ftell(boot_file);
-	fseek(boot_file, 0, SEEK_SET);
-	if (n>SPINNAKER_MAX_BOOT_SIZE)
-	{
-		last_error = SPINN_ERROR_BOOT_FILE_TOO_LARGE;
-		error_handler();
-		return SPINN_FAILURE;
-	}
-	blocks = n / SPINNAKER_BOOT_DATA_MAX;
-	if (n % SPINNAKER_BOOT_DATA_MAX != 0)
-		blocks++;
-
-	//common boot header data (big endian)
-	hdr.prot_ver = htons(1);
+		//start at the shortest block gap which has booted a board so far
+		pthread_mutex_lock(&boot_image_cache.lock);
+		gap = boot_image_cache.gap;
+		pthread_mutex_unlock(&boot_image_cache.lock);
+		pace_init(&ctx->boot_pacer, gap);
 
-
-	//send start
-	hdr.op = ntohl(SPINNAKER_BOOT_CMD_START);
-	hdr.a1 = 0;
-	hdr.a2 = 0;
-	hdr.a3 = ntohl(blocks-1);
-	send_boot_pkt(boot_sock, &boot_addr, &hdr, "", 0);
-
-	hdr.op = ntohl(SPINNAKER_BOOT_CMD_DATA);
-	hdr.a2 = 0;
-	hdr.a3 = 0;
-	//send data in blocks
-	for(i=0;i<blocks;i++)
-	{
-		//read block
-		int n = fread(boot_buffer, 1, SPINNAKER_BOOT_DATA_MAX, boot_file);
-		if (n <= 0)
+		if (!send_boot_image(ctx, boot_sock, &boot_addr))
 		{
-			last_error = SPINN_ERROR_BOOT_FILE_READING;
-			error_handler();
+			close(boot_sock);
 			return SPINN_FAILURE;
 		}
-		//send block
-		hdr.a1 = ntohl((((SPINNAKER_BOOT_DATA_MAX/4)-1)<<8)|((i)&255));
-		send_boot_pkt(boot_sock, &boot_addr, &hdr, boot_buffer, n);
-	}
 
-	//send end
-	hdr.op = ntohl(SPINNAKER_BOOT_CMD_END);
-	hdr.a1 = ntohl(1);
-	hdr.a2 = 0;
-	hdr.a3 = 0;
-	send_boot_pkt(boot_sock, &boot_addr, &hdr, "", 0);
+		//SCAMP answers quickly unless the boot rom dropped blocks, in which case the image is sent again more slowly
+		ready = wait_for_version(ctx, origin, (gap < SPINNAKER_BOOT_MAX_GAP) ? SPINNAKER_BOOT_ATTEMPT_TIMEOUT : SPINNAKER_READY_TIMEOUT);
+		pthread_mutex_lock(&boot_image_cache.lock);
+		if ((!ready)&&(gap == boot_image_cache.gap)&&(gap < SPINNAKER_BOOT_MAX_GAP))
+			boot_image_cache.gap = (gap*2 < SPINNAKER_BOOT_MAX_GAP) ? gap*2 : SPINNAKER_BOOT_MAX_GAP;
+		pthread_mutex_unlock(&boot_image_cache.lock);
+	}while((!ready)&&(gap < SPINNAKER_BOOT_MAX_GAP));
 
-	fclose(boot_file);
 	close(boot_sock);
 
-	usleep(SPINNAKER_CMD_DELAY*10);
+	if (!ready)
+	{
+		raise_error(ctx, SPINN_ERROR_BOOT_PKT_TIMEOUT);
+		return SPINN_FAILURE;
+	}
 
 	return SPINN_SUCCESS;
 }
@@ -69,7 +69,8 @@ typedef enum
 												   */
 	SPINN_ERROR_SDP_CMD_TIMEOUT,                 /** Error may be raised by most API functions which require communication with the host.
 	 	 	   	   	   	   	   	   	   	   	   	   * Error indicates that the system timed out trying the read a command
-	 	 	   	   	   	   	   	   	   	   	   	   * response or outgoing SDP message from the device. Usually raised by spiNN_init() if the device IP is
+	 	 	   	   	   	   	   	   	   	   	   	   * response or outgoing SDP message from the device. Idempotent commands (read, write and version)
+	 	 	   	   	   	   	   	   	   	   	   	   * are only reported after several retransmissions. Usually raised by spiNN_init() if the device IP is
 	 	 	   	   	   	   	   	   	   	   	   	   * valid but incorrect (i.e. device not on specified address).
 	 	 	   	   	   	   	   	   	   	   	   	   */
 	SPINN_ERROR_BOOT_PKT_SEND,					 /** Error may be raised by the spiNN_init() function indicating that there was a problem
@@ -87,12 +88,24 @@ typedef enum
 	SPINN_ERROR_SDP_VIRTUAL_PORT_RANGE,			 /** Error may be raised by the spiNN_send_SDP_message() function. Error is raised if the virtual port range
 	                                               * is not within the range of 1-MAX_VIRTUAL_PORTS (0 is reserved).
 	                                               */
-	SPINN_ERROR_ADDRESS_CORE_ID					 /** Error may be raised by any function accepting a SpiNN_address argument. Error is raised if the core_id value
+	SPINN_ERROR_ADDRESS_CORE_ID,				 /** Error may be raised by any function accepting a SpiNN_address argument. Error is raised if the core_id value
      	 	 	 	 	 	 	 	 	 	 	  * is not within the range of [0-(MAX_CORES_PER_CHIP-1)].
      	 	 	 	 	 	 	 	 	 	 	  */
+	SPINN_ERROR_REQUEST_LIMIT,					 /** Error may be raised by the asynchronous API functions. Error is raised if every request entry holds a
+												   * completion which has not been collected by spiNN_get_completion() or spiNN_wait().
+												   */
+	SPINN_ERROR_REQUEST_HANDLE					 /** Error may be raised by spiNN_wait(). Error is raised if the request handle is not outstanding (already
+												   * collected) or if the request was submitted with a completion callback.
+												   */
 
  } spiNN_error;
 
+/**
+ * Connection to a SpiNNaker board. Owns the sockets, transport state, error state and debug listener of the connection so that
+ * several boards can be driven from one process. Every API function accepting a context is thread safe.
+ */
+typedef struct spiNN_context spiNN_context;
+
 /**
  * Represents a SpiNNaker virtualised core number.
  */
@@ -112,6 +125,118 @@ typedef enum
  	unsigned char y;		//!< chip y position.
  } SpiNN_chip_address;
 
+ /**
+  * Determines how spiNN_init() brings up the board.
+  */
+ typedef enum
+ {
+	SPINN_BOOT_ALWAYS,				//!< always send the boot image (default).
+	SPINN_BOOT_ATTACH				//!< probe the SCAMP version first and only boot if no compatible version answers.
+ } spiNN_boot_mode;
+
+ /**
+  * Snapshot of the adaptive pacing and congestion control state of the command connection.
+  */
+ typedef struct
+ {
+	unsigned int rtt_us;			//!< smoothed round trip time estimate (us).
+	unsigned int rtt_var_us;		//!< round trip time variation (us).
+	unsigned int timeout_us;		//!< current response timeout derived from the rtt estimate (us).
+	unsigned int window;			//!< current congestion window (commands in flight).
+	unsigned int pace_us;			//!< current minimum gap between packets (us).
+	unsigned int commands_sent;		//!< number of command packets sent.
+	unsigned int responses;			//!< number of command responses received.
+	unsigned int timeouts;			//!< number of responses which timed out (losses).
+	unsigned int retransmits;		//!< number of idempotent commands sent again after a timeout.
+	unsigned int duplicates;		//!< number of duplicate responses which were discarded.
+ } spiNN_transport_stats;
+
+/**
+ * APLX table of fill and copy entries which initialises device memory on the chip (see spiNN_create_table()). Copies of literal
+ * data are staged in device memory after the table so that it is sent as a single contiguous write.
+ */
+typedef struct spiNN_table spiNN_table;
+
+/**
+ * Handle of an asynchronous request. A value of 0 indicates that the request could not be submitted.
+ */
+typedef int spiNN_request;
+
+/**
+ * State of an asynchronous request.
+ */
+typedef enum
+{
+	SPINN_REQUEST_PENDING,			//!< request has commands awaiting a response.
+	SPINN_REQUEST_COMPLETE,			//!< every command of the request was acknowledged.
+	SPINN_REQUEST_FAILED			//!< request was abandoned (see the error field).
+} spiNN_request_status;
+
+/**
+ * Completion of an asynchronous request as delivered to a completion callback or by spiNN_get_completion().
+ */
+typedef struct
+{
+	spiNN_request request;			//!< handle returned when the request was submitted.
+	spiNN_request_status status;	//!< SPINN_REQUEST_COMPLETE or SPINN_REQUEST_FAILED.
+	spiNN_error error;				//!< error which failed the request (SPINN_NO_ERROR if complete).
+	void* user_data;				//!< user data supplied when the request was submitted.
+} spiNN_completion;
+
+/**
+ * Completion callback of an asynchronous request. Called from spiNN_poll() (or any blocking API function) once the request
+ * has completed. The callback may submit further requests.
+ */
+typedef void (*spiNN_completion_callback)(spiNN_completion* completion);
+
+
+/**
+  * @brief Creates a context for a connection to a SpiNNaker board.
+  *
+  * The context is not connected until spiNN_init() is called. Options such as spiNN_set_debug_listener() and the error and debug
+  * callbacks may be set beforehand.
+  *
+  * @return 				A new context or NULL if the memory could not be allocated.
+  */
+spiNN_context* spiNN_create_context();
+
+/**
+  * @brief Enables or disables the debug message listener of a context.
+  *
+  * Only one context on a host can bind the debug port so the listener should be disabled for every board except one. Must be called
+  * before spiNN_init(). The listener is enabled by default.
+  *
+  * @param ctx				The context of the board connection (see spiNN_create_context()).
+  * @param listen			Non zero to bind the debug port and start the listener thread during spiNN_init().
+  */
+void spiNN_set_debug_listener(spiNN_context* ctx, int listen);
+
+/**
+  * @brief Sets whether spiNN_init() boots the board or attaches to a board which is already running SCAMP.
+  *
+  * In SPINN_BOOT_ATTACH mode a version query is sent with a short timeout before booting. If a compatible SCAMP version answers
+  * the boot image is not sent, so connecting to a board which is already booted takes milliseconds rather than seconds. Must be
+  * called before spiNN_init().
+  *
+  * @param ctx				The context of the board connection (see spiNN_create_context()).
+  * @param mode				SPINN_BOOT_ALWAYS (default) or SPINN_BOOT_ATTACH.
+  */
+void spiNN_set_boot_mode(spiNN_context* ctx, spiNN_boot_mode mode);
+
+/**
+  * @brief Waits until a chip answers a version query.
+  *
+  * Polls the monitor of the chip with version queries rather than sleeping for a fixed time. Used after booting and to check that
+  * point to point routes to every chip of the machine are ready.
+  *
+  * @param ctx				The context of the board connection (see spiNN_create_context()).
+  * @param chip				The SpiNNaker virtual chip address to poll.
+  * @param timeout_ms		Maximum time to wait (ms).
+  *
+  * @return 				SPINN_SUCCESS once the chip has answered. If it does not answer within the timeout a
+  * SPINN_ERROR_SDP_CMD_TIMEOUT error is raised and SPINN_FAILURE is returned.
+  */
+int spiNN_wait_for_chip(spiNN_context* ctx, SpiNN_chip_address chip, int timeout_ms);
 
 /**
   * @brief Connects the SpiNNaker device and performs system initialisation.
@@ -124,6 +249,7 @@ typedef enum
   * back to the host (i.e. the IP of SpiNNaker host API application) and the system point-to-point communication is
   * Initialised using the x and y dimensions which describe the virtual chip layout.
   *
+  * @param ctx				The context of the board connection (see spiNN_create_context()).
   * @param device_ip		The IP address of the SpiNNaker hardware device.
   * @param x_dimension		The X dimension of the virtual chip layout.
   * @param y_dimension		The Y dimension of the virtual chip layout.
@@ -131,7 +257,7 @@ typedef enum
   * @return 				Returns SPINN_SUCCESS if a connection with the SpiNN board was successful and if the debug
   * message listener was created successfully. SPINN_FAILURE if any errors where raised.
   */
- int spiNN_init(char* device_ip, int x_dimension, int y_dimension);
+ int spiNN_init(spiNN_context* ctx, char* device_ip, int x_dimension, int y_dimension);
 
 
 /**
@@ -139,6 +265,7 @@ typedef enum
   *
   * Usage is the same as spiNN_init() with an additional port option.
   *
+  * @param ctx				The context of the board connection (see spiNN_create_context()).
   * @param device_ip		The IP address of the SpiNNaker hardware device.
   * @param x_dimension		The X dimension of the virtual chip layout.
   * @param y_dimension		The Y dimension of the virtual chip layout.
@@ -147,7 +274,7 @@ typedef enum
   * @return 				Returns SPINN_SUCCESS if a connection with the SpiNN board was successful and if the
   * debug message listener was created successfully. SPINN_FAILURE if any errors where raised.
   */
-int spiNN_init_port(char* device_ip, int x_dimension, int y_dimension, unsigned int port);
+int spiNN_init_port(spiNN_context* ctx, char* device_ip, int x_dimension, int y_dimension, unsigned int port);
 
 
 /**
@@ -157,17 +284,21 @@ int spiNN_init_port(char* device_ip, int x_dimension, int y_dimension, unsigned
  * must have already been called to establish a connection. If the connection test is successful the console will indicate
  * that the SpiNNaker host API program is connected to the hardware.
  *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
+ *
  * @return 					Returns SPINN_SUCCESS if the yBoot version number was reported by the board successfully.
  * SPINN_FAILURE is returned if any errors where raised in sending or receiving commands to the board.
  */
-int spiNN_test_connection();
+int spiNN_test_connection(spiNN_context* ctx);
 
 /**
  * @brief Cleanup function to be used before exiting the SpiNNaker Host API program.
  *
- * Closes the connection, terminates debug threads and frees any allocated memory.
+ * Closes the connection, terminates debug threads and frees any allocated memory (including the context itself).
+ *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
  */
-void spiNN_exit();
+void spiNN_exit(spiNN_context* ctx);
 
 
 /**
@@ -175,19 +306,21 @@ void spiNN_exit();
  *
  * This performs an APLX command for the given core implying that the program must already have been loaded via spiNN_load_application().
  *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
  * @param address 			The virtual core address to start the loaded program.
  *
  * @return					Returns SPINN_SUCCESS if the APLX command was successful SPINN_FAILURE otherwise. If the user attempts
  * to start a program on the monitor core (i.e. core_id = 0) then a SPINN_ERROR_START_APP_ON_MONITOR error will be raised and SPINN_FAILURE
  * will be returned.
  */
-int spiNN_start_application(SpiNN_address address);
+int spiNN_start_application(spiNN_context* ctx, SpiNN_address address);
 
 /**
  * @brief Starts the application processor core execution from specified device address at the given spiNNaker address.
  *
  * This performs an APLX command for the given core implying that the program must already have been loaded via spiNN_load_application().
  *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
  * @param address 			The virtual core address to start the loaded program.
  * @param device_address 	The address in memory to start the APLX command.
  *
@@ -195,7 +328,23 @@ int spiNN_start_application(SpiNN_address address);
  * to start a program on the monitor core (i.e. core_id = 0) then a SPINN_ERROR_START_APP_ON_MONITOR error will be raised and SPINN_FAILURE
  * will be returned.
  */
-int spiNN_start_application_at(SpiNN_address address, unsigned int device_address);
+int spiNN_start_application_at(spiNN_context* ctx, SpiNN_address address, unsigned int device_address);
+
+/**
+ * @brief Asynchronous version of spiNN_start_application_at().
+ *
+ * The APLX command is queued and the function returns immediately. Completion is reported to the callback or, if the callback
+ * is NULL, held until collected by spiNN_wait() or spiNN_get_completion().
+ *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
+ * @param address 			The virtual core address to start the loaded program.
+ * @param device_address 	The address in memory to start the APLX command.
+ * @param callback			Completion callback (or NULL to use the completion queue).
+ * @param user_data			User data returned in the completion.
+ *
+ * @return					A request handle or 0 if the request could not be submitted (the error is raised immediately).
+ */
+spiNN_request spiNN_start_application_at_async(spiNN_context* ctx, SpiNN_address address, unsigned int device_address, spiNN_completion_callback callback, void* user_data);
 
 
 
@@ -206,13 +355,14 @@ int spiNN_start_application_at(SpiNN_address address, unsigned int device_addres
  * small data chunks. If it is not possible to open the specified file a SPINN_ERROR_LOAD_FILE_OPEN will be raised and the function
  * will return SPINN_FAILURE.
  *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
  * @param chip 				The SpiNNaker virtual chip address to load the application.
  * @param filename 			The application file to be loaded onto the device.
  *
  * @return 					If the file was successfully read and loaded without any problems then SPINN_SUCCESS will be returned
  * otherwise SPINN_FAILRE will be returned.
  */
-int spiNN_load_application(SpiNN_chip_address chip, char* filename);
+int spiNN_load_application(spiNN_context* ctx, SpiNN_chip_address chip, char* filename);
 
 
 /**
@@ -222,6 +372,7 @@ int spiNN_load_application(SpiNN_chip_address chip, char* filename);
  * the device in small data chunks. If it is not possible to open the specified file a SPINN_ERROR_LOAD_FILE_OPEN will be raised
  * and the function will return SPINN_FAILURE.
  *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
  * @param chip 				The SpiNNaker virtual chip address to load the application.
  * @param filename 			The application file to be loaded onto the device.
  * @param device_address	The device address to write the file contents to
@@ -229,14 +380,33 @@ int spiNN_load_application(SpiNN_chip_address chip, char* filename);
  * @return 					If the file was successfully read and loaded without any problems then SPINN_SUCCESS will be returned
  * otherwise SPINN_FAILRE will be returned.
  */
-int spiNN_load_application_at(SpiNN_address address, char* filename, unsigned int device_Address);
+int spiNN_load_application_at(spiNN_context* ctx, SpiNN_address address, char* filename, unsigned int device_Address);
+
+/**
+ * @brief Asynchronous version of spiNN_load_application_at().
+ *
+ * The file is read when the request is submitted (raising SPINN_ERROR_LOAD_FILE_OPEN immediately if it can not be read) and is
+ * then written to the device by the event loop.
+ *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
+ * @param address 			The SpiNNaker virtual core address to load the application.
+ * @param filename 			The application file to be loaded onto the device.
+ * @param device_address	The device address to write the file contents to
+ * @param callback			Completion callback (or NULL to use the completion queue).
+ * @param user_data			User data returned in the completion.
+ *
+ * @return					A request handle or 0 if the request could not be submitted.
+ */
+spiNN_request spiNN_load_application_at_async(spiNN_context* ctx, SpiNN_address address, char* filename, unsigned int device_address, spiNN_completion_callback callback, void* user_data);
 
 /**
  * @brief Read 'size' bytes of SpiNNaker memory at given address.
  *
  * 'size' bytes of memory are read in chunks from the SpiNNaker device at the given virtual core address and runtime memory device_address
- *  location. The resulting data is copied into host memory at the 'host_pointer' location.
+ *  location. The resulting data is copied into host memory at the 'host_pointer' location. Chunks are pipelined with a window
+ *  of read commands in flight and each response is matched to its command by sequence number.
  *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
  * @param address 			The SpiNNaker virtual core address to read memory from.
  * @param host_destination 	The host destination to store data read from the device.
  * @param device_address 	The device runtime memory address.
@@ -244,14 +414,34 @@ int spiNN_load_application_at(SpiNN_address address, char* filename, unsigned in
  *
  * @return If no errors were raised reading memory then SPINN_SUCCESS is returned otherwise SPINN_FAILURE is returned.
  */
-int spiNN_read_memory(SpiNN_address address, char* host_destination, unsigned int device_address, unsigned int size);
+int spiNN_read_memory(spiNN_context* ctx, SpiNN_address address, char* host_destination, unsigned int device_address, unsigned int size);
+
+/**
+ * @brief Asynchronous version of spiNN_read_memory().
+ *
+ * The read is split into chunks which are issued by the event loop alongside the chunks of any other outstanding requests, so
+ * transfers to different cores overlap. 'host_destination' must remain valid until the request completes.
+ *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
+ * @param address 			The SpiNNaker virtual core address to read memory from.
+ * @param host_destination 	The host destination to store data read from the device.
+ * @param device_address 	The device runtime memory address.
+ * @param size 				The size of data to read (bytes).
+ * @param callback			Completion callback (or NULL to use the completion queue).
+ * @param user_data			User data returned in the completion.
+ *
+ * @return					A request handle or 0 if the request could not be submitted.
+ */
+spiNN_request spiNN_read_memory_async(spiNN_context* ctx, SpiNN_address address, char* host_destination, unsigned int device_address, unsigned int size, spiNN_completion_callback callback, void* user_data);
 
 /**
  * @brief Writes 'size' bytes of SpiNNaker memory at given address.
  *
  * 'size' bytes of memory are written in chunks to the SpiNNaker device at the given virtual core address and runtime memory device_address
- *  location. The data written is copied from host memory at the 'host_pointer' location.
+ *  location. The data written is copied from host memory at the 'host_pointer' location. Chunks are pipelined with a window
+ *  of write commands in flight and the function returns once every chunk has been acknowledged.
  *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
  * @param address 			The SpiNNaker virtual core address to write memory to.
  * @param host_destination 	The host destination where data is copied form to the device.
  * @param device_address 	The device runtime memory address.
@@ -259,22 +449,256 @@ int spiNN_read_memory(SpiNN_address address, char* host_destination, unsigned in
  *
  * @return If no errors were raised writing memory then SPINN_SUCCESS is returned otherwise SPINN_FAILURE is returned.
  * */
-int spiNN_write_memory(SpiNN_address address, char* host_destination,  unsigned int device_address, unsigned int size);
+int spiNN_write_memory(spiNN_context* ctx, SpiNN_address address, char* host_destination,  unsigned int device_address, unsigned int size);
+
+/**
+ * @brief Asynchronous version of spiNN_write_memory().
+ *
+ * Data is sent directly from host memory so 'host_destination' must remain valid (and unchanged) until the request completes.
+ *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
+ * @param address 			The SpiNNaker virtual core address to write memory to.
+ * @param host_destination 	The host destination where data is copied form to the device.
+ * @param device_address 	The device runtime memory address.
+ * @param size 				The size of data to write (bytes).
+ * @param callback			Completion callback (or NULL to use the completion queue).
+ * @param user_data			User data returned in the completion.
+ *
+ * @return					A request handle or 0 if the request could not be submitted.
+ */
+spiNN_request spiNN_write_memory_async(spiNN_context* ctx, SpiNN_address address, char* host_destination, unsigned int device_address, unsigned int size, spiNN_completion_callback callback, void* user_data);
 
 /**
  * @brief Writes 'size' bytes of SpiNNaker memory at given address.
  *
  * 'size' bytes of memory are written in chunks to the SpiNNaker device at the given virtual core address and runtime memory device_address
- *  location. Only non zero values are copied. The data written is copied from host memory at the 'host_pointer' location.
+ *  location. Only non zero words are copied, although short runs of zeros between them may be written to save a packet (the
+ *  device memory is expected to be zero already). The data written is copied from host memory at the 'host_pointer' location.
+ *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
+ * @param address 			The SpiNNaker virtual core address to write memory to.
+ * @param host_destination 	The host destination where data is copied form to the device.
+ * @param device_address 	The device runtime memory address.
+ * @param size 				The size of data to write (bytes).
+ *
+ * @return If no errors were raised writing memory then SPINN_SUCCESS is returned otherwise SPINN_FAILURE is returned.
+ * */
+int spiNN_writenonzero_memory(spiNN_context* ctx, SpiNN_address address, char* host_destination,  unsigned int device_address, unsigned int size);
+
+/**
+ * @brief Asynchronous version of spiNN_writenonzero_memory().
  *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
  * @param address 			The SpiNNaker virtual core address to write memory to.
  * @param host_destination 	The host destination where data is copied form to the device.
  * @param device_address 	The device runtime memory address.
  * @param size 				The size of data to write (bytes).
+ * @param callback			Completion callback (or NULL to use the completion queue).
+ * @param user_data			User data returned in the completion.
+ *
+ * @return					A request handle or 0 if the request could not be submitted.
+ */
+spiNN_request spiNN_writenonzero_memory_async(spiNN_context* ctx, SpiNN_address address, char* host_destination, unsigned int device_address, unsigned int size, spiNN_completion_callback callback, void* user_data);
+
+/**
+ * @brief Writes 'size' bytes of SpiNNaker memory at given address as a compressed stream.
+ *
+ * The data is encoded as an APLX table (see spiNN_table_data()) of fill entries (runs of a repeated word) and copy entries
+ *  (repeated blocks and literal data which follows the table). The stream is written to the staging area and the table is then run by the core to expand it in place. As with
+ *  spiNN_writenonzero_memory() zero words are skipped (the device memory is expected to be zero already). If the stream is
+ *  larger than the staging area or would take longer to send and expand than a sparse write then spiNN_writenonzero_memory()
+ *  is used instead.
+ *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
+ * @param address 			The SpiNNaker virtual core address to write memory to (not the monitor).
+ * @param host_destination 	The host destination where data is copied form to the device.
+ * @param device_address 	The device runtime memory address.
+ * @param size 				The size of data to write (bytes).
+ * @param staging_address	The device memory address of a staging area which is not otherwise in use.
+ * @param staging_size		The size of the staging area (bytes).
  *
  * @return If no errors were raised writing memory then SPINN_SUCCESS is returned otherwise SPINN_FAILURE is returned.
  * */
-int spiNN_writenonzero_memory(SpiNN_address address, char* host_destination,  unsigned int device_address, unsigned int size);
+int spiNN_write_compressed_memory(spiNN_context* ctx, SpiNN_address address, char* host_destination, unsigned int device_address, unsigned int size, unsigned int staging_address, unsigned int staging_size);
+
+/**
+ * @brief Asynchronous version of spiNN_write_compressed_memory().
+ *
+ * 'host_destination' must remain valid (and unchanged) until the request completes as it is sent directly if the sparse write
+ *  is used.
+ *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
+ * @param address 			The SpiNNaker virtual core address to write memory to (not the monitor).
+ * @param host_destination 	The host destination where data is copied form to the device.
+ * @param device_address 	The device runtime memory address.
+ * @param size 				The size of data to write (bytes).
+ * @param staging_address	The device memory address of a staging area which is not otherwise in use.
+ * @param staging_size		The size of the staging area (bytes).
+ * @param callback			Completion callback (or NULL to use the completion queue).
+ * @param user_data			User data returned in the completion.
+ *
+ * @return					A request handle or 0 if the request could not be submitted.
+ */
+spiNN_request spiNN_write_compressed_memory_async(spiNN_context* ctx, SpiNN_address address, char* host_destination, unsigned int device_address, unsigned int size, unsigned int staging_address, unsigned int staging_size, spiNN_completion_callback callback, void* user_data);
+
+/**
+ * @brief Creates an empty APLX table.
+ *
+ * Entries are added with spiNN_table_fill(), spiNN_table_copy() and spiNN_table_data() and run in the order they were added by spiNN_run_table().
+ *
+ * @param staging_address	The device memory address the table (and its literal data) is written to before it is run.
+ *
+ * @return					The new table.
+ */
+spiNN_table* spiNN_create_table(unsigned int staging_address);
+
+/**
+ * @brief Frees a table which has not been run.
+ *
+ * @param t					The table.
+ */
+void spiNN_free_table(spiNN_table* t);
+
+/**
+ * @brief Adds an entry which fills device memory with a repeated word.
+ *
+ * @param t					The table.
+ * @param device_address	The device memory address (word aligned).
+ * @param size				The size of memory to fill (bytes, whole words).
+ * @param value				The value of every word.
+ */
+void spiNN_table_fill(spiNN_table* t, unsigned int device_address, unsigned int size, unsigned int value);
+
+/**
+ * @brief Adds entries which write host data to device memory.
+ *
+ * Runs of a repeated word become fill entries and blocks which repeat earlier data become copies of that data on the chip.
+ *  The remaining words are staged as literal data. Zero words are skipped so the device memory must already be zero (for
+ *  example filled by an earlier entry of the same table).
+ *
+ * @param t					The table.
+ * @param host_source		The host data.
+ * @param device_address	The device memory address (word aligned).
+ * @param size				The size of data (bytes, whole words).
+ */
+void spiNN_table_data(spiNN_table* t, const char* host_source, unsigned int device_address, unsigned int size);
+
+/**
+ * @brief Adds an entry which copies device memory (for example a program written once to memory shared by the cores of a chip).
+ *
+ * The source is read when the table runs so it must have been written before spiNN_run_table() is called.
+ *
+ * @param t					The table.
+ * @param device_address	The device memory address (word aligned).
+ * @param device_source		The device memory address copied from (word aligned).
+ * @param size				The size of memory to copy (bytes, whole words).
+ */
+void spiNN_table_copy(spiNN_table* t, unsigned int device_address, unsigned int device_source, unsigned int size);
+
+/**
+ * @brief Adds entries which write the contents of a file to device memory.
+ *
+ * The file is padded with zeros to whole words and written as with spiNN_table_data() after a fill entry clears its area.
+ *
+ * @param t					The table.
+ * @param filename			The file (for example an application binary).
+ * @param device_address	The device memory address (word aligned).
+ *
+ * @return If the file could be read then SPINN_SUCCESS is returned otherwise SPINN_FAILURE is returned.
+ * */
+int spiNN_table_file(spiNN_table* t, char* filename, unsigned int device_address);
+
+/**
+ * @brief Maps a program file into the host file cache.
+ *
+ * Files are mapped once (keyed by name) and are then written to the device directly from the mapped pages. Files with
+ * identical contents share one mapping. spiNN_load_application_at() and spiNN_table_file() map files on first use so this
+ * is only needed to find missing files before loading starts. Files must not change while they are cached.
+ *
+ * @param filename			The file (for example an application binary).
+ * @param size				Set to the size of the file (bytes) unless NULL.
+ * @param content_hash		Set to the hash of the contents of the file unless NULL.
+ *
+ * @return If the file could be mapped then SPINN_SUCCESS is returned otherwise SPINN_FAILURE is returned.
+ * */
+int spiNN_cache_file(char* filename, unsigned int* size, unsigned int* content_hash);
+
+/**
+ * @brief Gets the size of a table once complete.
+ *
+ * @param t					The table.
+ *
+ * @return					The number of bytes written to the staging area by spiNN_run_table() (entries and literal data).
+ */
+unsigned int spiNN_table_size(spiNN_table* t);
+
+/**
+ * @brief Writes a table to its staging address and runs it on a core.
+ *
+ * The table is freed. The last entry of the table marks its staging area once every other entry has run and the request
+ *  completes once the monitor reads that mark (so the memory it initialises may be used straight away). The request fails
+ *  with SPINN_ERROR_SDP_CMD_TIMEOUT if the table does not finish in time.
+ *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
+ * @param address 			The SpiNNaker virtual core address which runs the table (not the monitor).
+ * @param t					The table.
+ *
+ * @return If no errors were raised then SPINN_SUCCESS is returned otherwise SPINN_FAILURE is returned.
+ * */
+int spiNN_run_table(spiNN_context* ctx, SpiNN_address address, spiNN_table* t);
+
+/**
+ * @brief Asynchronous version of spiNN_run_table().
+ *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
+ * @param address 			The SpiNNaker virtual core address which runs the table (not the monitor).
+ * @param t					The table.
+ * @param callback			Completion callback (or NULL to use the completion queue).
+ * @param user_data			User data returned in the completion.
+ *
+ * @return					A request handle or 0 if the request could not be submitted.
+ */
+spiNN_request spiNN_run_table_async(spiNN_context* ctx, SpiNN_address address, spiNN_table* t, spiNN_completion_callback callback, void* user_data);
+
+/**
+ * @brief Runs the event loop for outstanding asynchronous requests.
+ *
+ * Fills the command window from the outstanding requests, retransmits overdue commands and waits (using epoll) for responses
+ * for at most 'timeout_ms' milliseconds. Completion callbacks are called from this function. The blocking API functions run the
+ * same event loop so requests also make progress while they wait.
+ *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
+ * @param timeout_ms		Maximum time to wait for responses (ms). 0 does not wait and -1 waits until the next response or timeout.
+ *
+ * @return					The number of requests which have not yet completed.
+ */
+int spiNN_poll(spiNN_context* ctx, int timeout_ms);
+
+/**
+ * @brief Waits for an asynchronous request submitted without a callback to complete.
+ *
+ * Runs the event loop until the request completes and then releases the request handle. If the request failed its error is raised
+ * (see spiNN_set_error_callback()). Requests submitted with a completion callback can not be waited on.
+ *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
+ * @param request			Request handle. If 0 (submission failed) SPINN_FAILURE is returned immediately.
+ *
+ * @return					SPINN_SUCCESS if the request completed without errors otherwise SPINN_FAILURE.
+ */
+int spiNN_wait(spiNN_context* ctx, spiNN_request request);
+
+/**
+ * @brief Collects the oldest completion of the requests submitted without a callback.
+ *
+ * Does not run the event loop (see spiNN_poll()). The request handle is released and the error of a failed request is
+ * returned in the completion rather than raised.
+ *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
+ * @param completion		Pointer to a spiNN_completion structure to receive the completion.
+ *
+ * @return					SPINN_SUCCESS if a completion was collected. SPINN_FAILURE if the completion queue is empty.
+ */
+int spiNN_get_completion(spiNN_context* ctx, spiNN_completion* completion);
 
 
 /**
@@ -284,6 +708,7 @@ int spiNN_writenonzero_memory(SpiNN_address address, char* host_destination,  un
  * Datagram Packet (SDP) message. If message_len is greater than 256 then the function will raise a SPINN_ERROR_SDP_DATA_SIZE
  * error and returns SPINN_FAILURE.
  *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
  * @param address 			The SpiNNaker virtual core address to send the SDP message.
  * @param virtual_port		Virtual port number to send SDP message via range of 1-MAX_VIRTUAL_PORTS]. 0 is reserved.
  * @param message 			Pointer to data to be contained within the SDP message.
@@ -292,7 +717,7 @@ int spiNN_writenonzero_memory(SpiNN_address address, char* host_destination,  un
  * @return					If the message is sent without raising any errors then SPINN_SUCCESS is returned otherwise
  * SPINN_FAILURE is returned.
  */
-int spiNN_send_SDP_message(SpiNN_address address, char virtual_port, char* message, unsigned int message_len);
+int spiNN_send_SDP_message(spiNN_context* ctx, SpiNN_address address, char virtual_port, char* message, unsigned int message_len);
 
 /**
  * @brief Receives an SDP message into the system.
@@ -303,6 +728,7 @@ int spiNN_send_SDP_message(SpiNN_address address, char virtual_port, char* messa
  * out. In the case of a timeout a SPINN_ERROR_SDP_TIMEOUT error will be raised an the function will return SPINN_FAILURE. If
  * message_len is greater than 256 then the function will raise a SPINN_ERROR_SDP_DATA_SIZE error and returns SPINN_FAILURE.
  *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
  * @param source			Pointer to a SpiNN_address structure to hold the originating message address.
  * @param virtual_port		Pointer to a char which will be set to the virtual port number to SDP message was received via. Range of 1-MAX_VIRTUAL_PORTS]. 0 is reserved.
  * @param message			Pointer to memory to store the incoming message data.
@@ -310,7 +736,7 @@ int spiNN_send_SDP_message(SpiNN_address address, char virtual_port, char* messa
  * @return					If the message is received without raising any errors then SPINN_SUCCESS is returned otherwise
  * SPINN_FAILURE is returned.
  */
-int spiNN_receive_SDP_message(SpiNN_address* source, char* virtual_port, char* message, int message_len);
+int spiNN_receive_SDP_message(spiNN_context* ctx, SpiNN_address* source, char* virtual_port, char* message, int message_len);
 
 /**
  * @brief Sets the Debug (device stdout) message handler to the function pointer supplied which accepts a message as an argument.
@@ -318,10 +744,11 @@ int spiNN_receive_SDP_message(SpiNN_address* source, char* virtual_port, char* m
  * The host side API polls for messages in a separate thread and calls the assigned message handler when a message is received.
  * By default the spiNN_handle_debug_message() message handler is assigned.
  *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
  * @param receive_message 	Pointer to a function which accepts a SpiNN_address and char* as an argument to handle debug messages.
  * See spiNN_handle_debug_message() for an example.
  */
-void spiNN_debug_message_callback(void (*receive_message)(SpiNN_address, char*));
+void spiNN_debug_message_callback(spiNN_context* ctx, void (*receive_message)(SpiNN_address, char*));
 
 /**
  * @brief Default message handler for debug messages.
@@ -334,25 +761,43 @@ void spiNN_debug_message_callback(void (*receive_message)(SpiNN_address, char*))
 void spiNN_handle_debug_message(SpiNN_address address, char* message);
 
 
+/**
+ * @brief Gets the current pacing state and round trip time estimate of the command connection.
+ *
+ * Commands are not separated by a fixed delay. The host measures the round trip time of each command and grows the number of
+ * commands in flight (additive increase) until responses are lost, at which point the window is halved and the timeout backed
+ * off (multiplicative decrease). Packets within a window are spread over one round trip: each is given a send deadline and the
+ * event loop waits (with the context unlocked) until the next deadline, sending packets due within 1 ms of each other as one
+ * batch. This function copies the current state so that it can be logged.
+ *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
+ * @param stats				Pointer to a spiNN_transport_stats structure to receive the current state.
+ */
+void spiNN_get_transport_stats(spiNN_context* ctx, spiNN_transport_stats* stats);
+
 /**
  * @brief Sets an error callback function which is called if an error occurs at runtime.
  *
  * The specified error callback function is called whenever an error occurs at runtime within the SpiNNaker Host API. The default error
  * callback is spiNN_print_error().
  *
- * @param error_callback	Pointer to an error callback function (accepting no arguments) which is used to handle errors at runtime.
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
+ * @param error_callback	Pointer to an error callback function (accepting the context and the error code raised) which is used to handle
+ * errors at runtime. The error is passed to the callback so that handlers are not affected by errors raised concurrently by other threads.
  * Default is spiNN_print_error().
  */
-void spiNN_set_error_callback(void (*error_callback)(void));
+void spiNN_set_error_callback(spiNN_context* ctx, void (*error_callback)(spiNN_context*, spiNN_error));
 
 /**
  * @brief Gets the last known error code.
  *
- * Returns the last known error code raised. If no error has occurred then SPINN_NO_ERROR will be returned.
+ * Returns the last known error code raised by any thread using the context. If no error has occurred then SPINN_NO_ERROR will be returned.
+ *
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
  *
  * @return 					The last known error code. SPINN_NO_ERROR if no errors.
  */
-spiNN_error spiNN_get_error();
+spiNN_error spiNN_get_error(spiNN_context* ctx);
 
 /**
  * @brief Gets the error string description given an error code.
@@ -368,10 +813,13 @@ const char* spiNN_get_error_string(spiNN_error error);
 /**
  * @brief Default error callback.
  *
- * Default error callback prints the error code and string description to the console.
+ * Default error callback prints the error code, the IP address of the board and the string description to the console.
+ *
+ * @param error				The error code raised.
+ * @param ctx				The context of the board connection (see spiNN_create_context()).
  */
 
-void spiNN_print_error(void);
+void spiNN_print_error(spiNN_context* ctx, spiNN_error error);
 
 /*
  * Functions suggested by Manchester